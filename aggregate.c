@@ -0,0 +1,238 @@
+/*
+ *! aggregate.c
+ *!
+ *! Summarises the records by hour, day or week (weeks start on a Monday): the
+ *! minimum, maximum and mean of temperature, humidity, pressure, wind and gust,
+ *! and the rain that fell. Records are dated as listRecords() dates them, from
+ *! the timestamp index (tindex.h), and read a run at a time into columns
+ *! (wbatch.h), so nothing goes through struct weatherRecord or text.
+ *!
+ *! Records come newest first, so the periods do too: each row is put out as
+ *! soon as a record from an earlier period turns up.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "config.h"
+#include "cmdline.h"
+#include "header.h"
+#include "wbatch.h"
+#include "tindex.h"
+#include "utctime.h"
+#include "outbuf.h"
+#include "wrecord.h"
+#include "aggregate.h"
+
+#define AggregateRun    1024            // records read into columns at a time
+
+// the measurements summarised, in the order they are listed
+enum { aTempOut, aHumOut, aTempIn, aHumIn, aPress, aWindSpeed, aGustSpeed, AggregateFields };
+
+static const char* fieldNames[AggregateFields] = { "oTemp", "hO", "iTemp", "hI", "Pres", "wSpd", "gSpd" };
+
+// humidities are whole percentages, the rest are held in tenths
+static const int inTenths[AggregateFields] = { 1, 0, 1, 0, 1, 1, 1 };
+
+struct bucket {
+    time_t      start;
+    int         records;
+    long        min[AggregateFields];
+    long        max[AggregateFields];
+    long        sum[AggregateFields];
+    long        rain;                   // in tenths, as the rain counter
+};
+
+
+int aggregateperiod(const char* name) {
+    static const char* names[] = { "hour", "day", "week" };
+
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//! Start of the period the given time falls in.
+//
+static time_t bucketStart(time_t time, int period) {
+    long length = (period == AggregateHour) ? 3600 : 86400;
+    long start = time - ((time % length) + length) % length;
+
+    if (period == AggregateWeek) {
+        // 1970-01-01 was a Thursday, three days on from a Monday
+        long day = start / 86400;
+        start -= (((day + 3) % 7 + 7) % 7) * 86400;
+    }
+    return start;
+}
+
+static void bucketClear(struct bucket* b, time_t start) {
+    b->start = start;
+    b->records = 0;
+    b->rain = 0;
+    for (int f = 0; f < AggregateFields; f++) {
+        b->min[f] = 0;
+        b->max[f] = 0;
+        b->sum[f] = 0;
+    }
+}
+
+static void bucketAdd(struct bucket* b, const long* value, long rain) {
+    for (int f = 0; f < AggregateFields; f++) {
+        if (b->records == 0 || value[f] < b->min[f]) {
+            b->min[f] = value[f];
+        }
+        if (b->records == 0 || value[f] > b->max[f]) {
+            b->max[f] = value[f];
+        }
+        b->sum[f] += value[f];
+    }
+    b->rain += rain;
+    b->records++;
+}
+
+//! Column headings for -v.
+//
+static void bucketHeadings() {
+    oputs("UTC date        ");
+    oputs(fieldseparator);
+    oputs("n");
+    for (int f = 0; f < AggregateFields; f++) {
+        static const char* suffix[] = { "Min", "Max", "Mean" };
+        for (int s = 0; s < 3; s++) {
+            oputs(fieldseparator);
+            oputs(fieldNames[f]);
+            oputs(suffix[s]);
+        }
+    }
+    oputs(fieldseparator);
+    oputs("rain");
+    oputc('\n');
+}
+
+//! Mean in tenths, rounded half away from zero.
+//
+static long meanTenths(long sum, int count) {
+    return (sum >= 0) ? (sum + count / 2) / count : (sum - count / 2) / count;
+}
+
+static void bucketPrint(const struct bucket* b) {
+    char date[17];
+
+    utcFormat(date, b->start);
+    oputs(date);
+    oputs(fieldseparator);
+    oint(b->records, 0);
+    for (int f = 0; f < AggregateFields; f++) {
+        oputs(fieldseparator);
+        if (inTenths[f]) {
+            otenths(b->min[f], 0);
+            oputs(fieldseparator);
+            otenths(b->max[f], 0);
+            oputs(fieldseparator);
+            otenths(meanTenths(b->sum[f], b->records), 0);
+        }
+        else {
+            oint(b->min[f], 0);
+            oputs(fieldseparator);
+            oint(b->max[f], 0);
+            oputs(fieldseparator);
+            otenths(meanTenths(b->sum[f] * 10, b->records), 0);
+        }
+    }
+    oputs(fieldseparator);
+    otenths(b->rain, 0);
+    oputc('\n');
+    rstats()->rows++;
+}
+
+//! List a summary row per period for records start..end. The rain for a record
+//! is the rise in the rain counter since the record before it (modulo the
+//! 16 bit counter), so one more record than listed is read when there is one.
+//
+void aggregateRecords(int start, int end, int period) {
+    struct weatherColumns cols;
+    struct bucket b;
+    int have = false;
+
+    int records = getRecordsStored();
+    if (end >= records) {
+        end = records - 1;
+    }
+    if (start > end) {
+        return;
+    }
+
+    time_t devtime = utcParse(getDateTime());
+
+    if (!allocColumns(&cols, AggregateRun + 1)) {
+        printf("ERROR: unable to allocate columns for -A, aborting...\n");
+        exit(1);
+    }
+
+    if (options.verbose == 1) {
+        bucketHeadings();
+    }
+
+    for (int first = start; first <= end; first += AggregateRun) {
+        int n = (end - first + 1 < AggregateRun) ? end - first + 1 : AggregateRun;
+        int m = (first + n < records) ? n + 1 : n;
+
+        readColumns(&cols, first, m);
+
+        for (int k = 0; k < n; k++) {
+            time_t time = devtime - tminutes(first + k) * 60;
+            time_t bs = bucketStart(time, period);
+
+            if (!have || bs != b.start) {
+                if (have) {
+                    bucketPrint(&b);
+                }
+                bucketClear(&b, bs);
+                have = true;
+            }
+
+            long value[AggregateFields];
+            value[aTempOut]   = cols.tempOut[k];
+            value[aHumOut]    = cols.humOut[k];
+            value[aTempIn]    = cols.tempIn[k];
+            value[aHumIn]     = cols.humIn[k];
+            value[aPress]     = cols.press[k];
+            value[aWindSpeed] = cols.windSpeed[k];
+            value[aGustSpeed] = cols.gustSpeed[k];
+
+            long rain = (k + 1 < m) ? (uint16_t) (cols.rainCounter[k] - cols.rainCounter[k + 1]) : 0;
+
+            bucketAdd(&b, value, rain);
+        }
+    }
+
+    if (have) {
+        bucketPrint(&b);
+    }
+    freeColumns(&cols);
+}
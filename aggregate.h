@@ -0,0 +1,32 @@
+/*
+ * File:   aggregate.h
+ *
+ * Hourly, daily and weekly summaries of the stored records (-A).
+ */
+
+// V0.1
+
+#ifndef _AGGREGATE_H
+#define	_AGGREGATE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    enum aggregatePeriod {
+        AggregateHour = 0,
+        AggregateDay,
+        AggregateWeek
+    };
+
+    // the period named by "hour", "day" or "week", -1 if none of them
+    int aggregateperiod(const char* name);
+
+    // list a summary row per period for records start..end (0 = current)
+    void aggregateRecords(int start, int end, int period);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _AGGREGATE_H */
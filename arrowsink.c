@@ -0,0 +1,509 @@
+/*
+ *! arrowsink.c
+ *!
+ *! Writes listed records as an Arrow IPC file (the "Feather v2" format that
+ *! pyarrow, pandas, polars, duckdb etc. read), one column per record field plus
+ *! the time of the record as a UTC timestamp in seconds:
+ *!
+ *!     timestamp       timestamp[s, UTC]
+ *!     memPos          uint16
+ *!     interval, humIn, humOut, windDir, errorCode
+ *!                     uint8
+ *!     tempIn, tempOut, press, windSpeed, gustSpeed, rainCounter
+ *!                     float32 (the device's tenths / 10)
+ *!
+ *! Rows are collected into batches of ArrowBatch records, each written as an
+ *! Arrow record batch, so memory use doesn't grow with the listing. Buffers in
+ *! the file are 64 byte aligned, so a reader can map the file and use the
+ *! columns where they lie.
+ *!
+ *! The metadata is made of flatbuffers, built here by a small builder (back to
+ *! front, as flatbuffers are) rather than with the flatbuffers library. Both the
+ *! flatbuffers and the column data are little endian, as the hosts wsrdr runs on
+ *! are.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "header.h"
+#include "wrecord.h"
+#include "arrowsink.h"
+
+#define ArrowBatch      1024            // rows per record batch
+#define ArrowAlign      64              // alignment of buffers in the file
+#define ArrowV5         4               // MetadataVersion.V5
+
+// flatbuffer union types used (Schema.fbs, Message.fbs)
+#define TypeInt         2
+#define TypeFloat       3
+#define TypeTimestamp   10
+#define HeaderSchema    1
+#define HeaderBatch     3
+
+enum columnType { colUint, colFloat, colTimestamp };
+
+static const struct column {
+    const char*     name;
+    int             type;
+    int             width;              // bytes per value
+} columns[] = {
+    { "timestamp",   colTimestamp, 8 },
+    { "memPos",      colUint,      2 },
+    { "interval",    colUint,      1 },
+    { "humIn",       colUint,      1 },
+    { "tempIn",      colFloat,     4 },
+    { "humOut",      colUint,      1 },
+    { "tempOut",     colFloat,     4 },
+    { "press",       colFloat,     4 },
+    { "windSpeed",   colFloat,     4 },
+    { "gustSpeed",   colFloat,     4 },
+    { "windDir",     colUint,      1 },
+    { "rainCounter", colFloat,     4 },
+    { "errorCode",   colUint,      1 },
+};
+
+#define Columns         ((int) (sizeof(columns) / sizeof(columns[0])))
+
+// the structs of Message.fbs and File.fbs, as they lie in a flatbuffer
+struct fieldNode { int64_t length; int64_t nullCount; };
+struct bufferSpec { int64_t offset; int64_t length; };
+struct block { int64_t offset; int32_t metaDataLength; int32_t pad; int64_t bodyLength; };
+
+static FILE* afile = NULL;
+static const char* apath;
+static long position = 0;               // bytes written to the file
+static unsigned char* data[Columns];    // the batch being collected
+static int rows = 0;
+static struct block* blocks = NULL;     // where the batches went, for the footer
+static int batches = 0;
+
+
+////////////////////////////////////////////////////////////////////////////
+//
+//   F L A T B U F F E R S
+
+struct flatbuilder {
+    unsigned char*  buf;
+    size_t          capacity;
+    size_t          size;               // bytes used, at the end of buf
+    size_t          minalign;
+    uint32_t        field[8];           // where the fields of the open table are
+    int             fields;
+    size_t          table;              // size when the open table was started
+};
+
+static struct flatbuilder fb;
+
+static void fbreset() {
+    fb.size = 0;
+    fb.minalign = 1;
+}
+
+static void fbgrow(size_t need) {
+    if (fb.size + need <= fb.capacity) {
+        return;
+    }
+    size_t capacity = fb.capacity ? fb.capacity * 2 : 1024;
+    while (capacity < fb.size + need) {
+        capacity *= 2;
+    }
+    unsigned char* buf = malloc(capacity);
+    if (buf == NULL) {
+        printf("ERROR: unable to allocate arrow metadata, aborting...\n");
+        exit(1);
+    }
+    if (fb.size > 0) {
+        memcpy(buf + capacity - fb.size, fb.buf + fb.capacity - fb.size, fb.size);
+    }
+    free(fb.buf);
+    fb.buf = buf;
+    fb.capacity = capacity;
+}
+
+static void fbpush(const void* bytes, size_t n) {
+    fbgrow(n);
+    fb.size += n;
+    memcpy(fb.buf + fb.capacity - fb.size, bytes, n);
+}
+
+static void fbpad(size_t n) {
+    fbgrow(n);
+    fb.size += n;
+    memset(fb.buf + fb.capacity - fb.size, 0, n);
+}
+
+//! Pad so that once additional bytes are pushed, size is a multiple of align.
+//
+static void fbprep(size_t align, size_t additional) {
+    if (align > fb.minalign) {
+        fb.minalign = align;
+    }
+    fbpad((~(fb.size + additional) + 1) & (align - 1));
+}
+
+static void fbscalar(const void* value, size_t n) {
+    fbprep(n, 0);
+    fbpush(value, n);
+}
+
+//! Push an offset to something already built (offsets point forwards).
+//
+static void fbuoffset(uint32_t target) {
+    fbprep(4, 0);
+    uint32_t offset = fb.size - target + 4;
+    fbpush(&offset, 4);
+}
+
+static void fbstart(int fields) {
+    memset(fb.field, 0, sizeof(fb.field));
+    fb.fields = fields;
+    fb.table = fb.size;
+}
+
+static void fbfield(int id, const void* value, size_t n) {
+    fbscalar(value, n);
+    fb.field[id] = fb.size;
+}
+
+static void fbfieldoffset(int id, uint32_t target) {
+    fbuoffset(target);
+    fb.field[id] = fb.size;
+}
+
+//! Finish the open table, with its vtable in front of it.
+//
+static uint32_t fbend() {
+    int32_t placeholder = 0;
+    fbprep(4, 0);
+    fbpush(&placeholder, 4);
+    uint32_t object = fb.size;
+
+    for (int id = fb.fields - 1; id >= 0; id--) {
+        uint16_t at = fb.field[id] ? object - fb.field[id] : 0;
+        fbpush(&at, 2);
+    }
+    uint16_t tableSize = object - fb.table;
+    uint16_t vtableSize = (fb.fields + 2) * 2;
+    fbpush(&tableSize, 2);
+    fbpush(&vtableSize, 2);
+
+    int32_t vtable = fb.size - object;
+    memcpy(fb.buf + fb.capacity - object, &vtable, 4);
+    return object;
+}
+
+//! A vector of count elements of size bytes (pushed last first), then its length.
+//
+static void fbstartvector(size_t size, int count, size_t align) {
+    fbprep(4, size * count);
+    fbprep(align, size * count);
+}
+
+static uint32_t fbendvector(int count) {
+    uint32_t length = count;
+    fbpush(&length, 4);
+    return fb.size;
+}
+
+static uint32_t fbstring(const char* string) {
+    size_t length = strlen(string);
+    fbprep(4, length + 1);
+    fbpad(1);
+    fbpush(string, length);
+    return fbendvector(length);
+}
+
+static void fbfinish(uint32_t root) {
+    fbprep(fb.minalign, 4);
+    fbuoffset(root);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//
+//   A R R O W
+
+static void awrite(const void* bytes, size_t n) {
+    if (n > 0 && fwrite(bytes, n, 1, afile) != 1) {
+        printf("ERROR: unable to write %s, aborting...\n", apath);
+        exit(1);
+    }
+    position += n;
+}
+
+static void awritepad(size_t n) {
+    static const char zeros[ArrowAlign];
+    awrite(zeros, n);
+}
+
+//! Pad n bytes up to a multiple of align.
+//
+static size_t aligned(size_t n, size_t align) {
+    return (n + align - 1) & ~(align - 1);
+}
+
+//! Build the type of a column (Schema.fbs Int, FloatingPoint or Timestamp).
+//
+static uint32_t buildType(const struct column* c) {
+    if (c->type == colTimestamp) {
+        uint32_t zone = fbstring("UTC");
+        int16_t unit = 0;                       // TimeUnit.SECOND
+        fbstart(2);
+        fbfield(0, &unit, 2);
+        fbfieldoffset(1, zone);
+        return fbend();
+    }
+    if (c->type == colFloat) {
+        int16_t precision = 1;                  // Precision.SINGLE
+        fbstart(1);
+        fbfield(0, &precision, 2);
+        return fbend();
+    }
+    int32_t bitWidth = c->width * 8;
+    uint8_t isSigned = 0;
+    fbstart(2);
+    fbfield(0, &bitWidth, 4);
+    fbfield(1, &isSigned, 1);
+    return fbend();
+}
+
+static uint32_t buildSchema() {
+    uint32_t fields[Columns];
+
+    for (int i = 0; i < Columns; i++) {
+        const struct column* c = &columns[i];
+        uint32_t name = fbstring(c->name);
+        uint32_t type = buildType(c);
+        fbstartvector(4, 0, 4);
+        uint32_t children = fbendvector(0);
+
+        uint8_t nullable = 1;
+        uint8_t typeType = (c->type == colTimestamp) ? TypeTimestamp : (c->type == colFloat) ? TypeFloat : TypeInt;
+        fbstart(6);
+        fbfieldoffset(0, name);
+        fbfieldoffset(3, type);
+        fbfieldoffset(5, children);
+        fbfield(1, &nullable, 1);
+        fbfield(2, &typeType, 1);
+        fields[i] = fbend();
+    }
+
+    fbstartvector(4, Columns, 4);
+    for (int i = Columns - 1; i >= 0; i--) {
+        fbuoffset(fields[i]);
+    }
+    uint32_t fieldVector = fbendvector(Columns);
+
+    int16_t endianness = 0;                     // Endianness.Little
+    fbstart(4);
+    fbfieldoffset(1, fieldVector);
+    fbfield(0, &endianness, 2);
+    return fbend();
+}
+
+//! Wrap a header in a Message and write it out (continuation marker, length,
+//! flatbuffer, padding). The padding takes the end of the message to a multiple
+//! of ArrowAlign in the file, so a record batch body after it starts aligned.
+//! Returns the bytes written.
+//
+static int32_t writeMessage(uint8_t headerType, uint32_t header, int64_t bodyLength) {
+    int16_t version = ArrowV5;
+    fbstart(5);
+    fbfieldoffset(2, header);
+    fbfield(3, &bodyLength, 8);
+    fbfield(0, &version, 2);
+    fbfield(1, &headerType, 1);
+    fbfinish(fbend());
+
+    uint32_t continuation = 0xFFFFFFFF;
+    int32_t length = aligned(position + 8 + fb.size, ArrowAlign) - position - 8;
+    awrite(&continuation, 4);
+    awrite(&length, 4);
+    awrite(fb.buf + fb.capacity - fb.size, fb.size);
+    awritepad(length - fb.size);
+    return 8 + length;
+}
+
+//! Write the rows collected as a record batch.
+//
+static void writeBatch() {
+    struct fieldNode nodes[Columns];
+    struct bufferSpec buffers[2 * Columns];
+    int64_t body = 0;
+
+    for (int i = 0; i < Columns; i++) {
+        nodes[i].length = rows;
+        nodes[i].nullCount = 0;
+        // no nulls, so no validity bitmap
+        buffers[2 * i].offset = body;
+        buffers[2 * i].length = 0;
+        buffers[2 * i + 1].offset = body;
+        buffers[2 * i + 1].length = (int64_t) rows * columns[i].width;
+        body += aligned(buffers[2 * i + 1].length, ArrowAlign);
+    }
+
+    fbreset();
+    fbstartvector(sizeof(struct bufferSpec), 2 * Columns, 8);
+    for (int i = 2 * Columns - 1; i >= 0; i--) {
+        fbpush(&buffers[i], sizeof(struct bufferSpec));
+    }
+    uint32_t bufferVector = fbendvector(2 * Columns);
+    fbstartvector(sizeof(struct fieldNode), Columns, 8);
+    for (int i = Columns - 1; i >= 0; i--) {
+        fbpush(&nodes[i], sizeof(struct fieldNode));
+    }
+    uint32_t nodeVector = fbendvector(Columns);
+
+    int64_t length = rows;
+    fbstart(3);
+    fbfield(0, &length, 8);
+    fbfieldoffset(1, nodeVector);
+    fbfieldoffset(2, bufferVector);
+    uint32_t batch = fbend();
+
+    struct block* more = realloc(blocks, (batches + 1) * sizeof(struct block));
+    if (more == NULL) {
+        printf("ERROR: unable to allocate arrow metadata, aborting...\n");
+        exit(1);
+    }
+    blocks = more;
+    blocks[batches].offset = position;
+    blocks[batches].pad = 0;
+    blocks[batches].bodyLength = body;
+    blocks[batches].metaDataLength = writeMessage(HeaderBatch, batch, body);
+    batches++;
+
+    // the message ends aligned, pad each buffer of the body out to the alignment
+    for (int i = 0; i < Columns; i++) {
+        size_t bytes = (size_t) rows * columns[i].width;
+        awrite(data[i], bytes);
+        awritepad(aligned(bytes, ArrowAlign) - bytes);
+    }
+    rows = 0;
+}
+
+void arrowopen(const char* path) {
+    apath = path;
+    if ((afile = fopen(path, "wb")) == NULL) {
+        printf("ERROR: unable to create %s\n", path);
+        exit(1);
+    }
+    for (int i = 0; i < Columns; i++) {
+        if ((data[i] = malloc(ArrowBatch * columns[i].width)) == NULL) {
+            printf("ERROR: unable to allocate arrow columns, aborting...\n");
+            exit(1);
+        }
+    }
+
+    awrite("ARROW1\0\0", 8);
+    fbreset();
+    writeMessage(HeaderSchema, buildSchema(), 0);
+}
+
+//! Store a value in column i of the current row.
+//
+#define setColumn(i, type, value)   (((type*) data[i])[rows] = (value))
+
+void arrowrecord(weatherRecordPtr record, time_t time) {
+    char* raw = (char*) record->rawdata;
+
+    setColumn(0,  int64_t,  time);
+    setColumn(1,  uint16_t, record->memPos);
+    setColumn(2,  uint8_t,  record->interval);
+    setColumn(3,  uint8_t,  record->humIn);
+    setColumn(4,  float,    getSignedInt(raw + 0x02) / 10.0f);
+    setColumn(5,  uint8_t,  record->humOut);
+    setColumn(6,  float,    getSignedInt(raw + 0x05) / 10.0f);
+    setColumn(7,  float,    getUnsignedInt(raw + 0x07) / 10.0f);
+    setColumn(8,  float,    (raw[0x09] & 0xFF) / 10.0f);
+    setColumn(9,  float,    getUnsignedInt(raw + 0x0A) / 10.0f);
+    setColumn(10, uint8_t,  record->windDir);
+    setColumn(11, float,    getUnsignedInt(raw + 0x0D) / 10.0f);
+    setColumn(12, uint8_t,  record->errorCode);
+
+    if (++rows == ArrowBatch) {
+        writeBatch();
+    }
+}
+
+void arrowflush() {
+    if (afile == NULL) {
+        return;
+    }
+    if (rows > 0) {
+        writeBatch();
+    }
+    fflush(afile);
+}
+
+void arrowclose() {
+    if (afile == NULL) {
+        return;
+    }
+    if (rows > 0 || batches == 0) {
+        writeBatch();
+    }
+
+    // end of stream
+    uint32_t eos[2] = { 0xFFFFFFFF, 0 };
+    awrite(eos, 8);
+
+    // the footer repeats the schema and says where the batches are
+    fbreset();
+    uint32_t schema = buildSchema();
+    fbstartvector(sizeof(struct block), batches, 8);
+    for (int i = batches - 1; i >= 0; i--) {
+        fbpush(&blocks[i], sizeof(struct block));
+    }
+    uint32_t blockVector = fbendvector(batches);
+    fbstartvector(sizeof(struct block), 0, 8);
+    uint32_t dictionaries = fbendvector(0);
+
+    int16_t version = ArrowV5;
+    fbstart(4);
+    fbfieldoffset(1, schema);
+    fbfieldoffset(2, dictionaries);
+    fbfieldoffset(3, blockVector);
+    fbfield(0, &version, 2);
+    fbfinish(fbend());
+
+    int32_t footer = fb.size;
+    awrite(fb.buf + fb.capacity - fb.size, fb.size);
+    awrite(&footer, 4);
+    awrite("ARROW1", 6);
+
+    if (fclose(afile) != 0) {
+        printf("ERROR: unable to write %s, aborting...\n", apath);
+        exit(1);
+    }
+    afile = NULL;
+    for (int i = 0; i < Columns; i++) {
+        free(data[i]);
+    }
+    free(blocks);
+    blocks = NULL;
+    batches = 0;
+}
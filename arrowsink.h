@@ -0,0 +1,36 @@
+/*
+ * File:   arrowsink.h
+ *
+ * Writes listed records as an Arrow IPC file (-o arrow:path).
+ */
+
+// V0.1
+
+#ifndef _ARROWSINK_H
+#define	_ARROWSINK_H
+
+#include <time.h>
+
+#include "wrecord.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // create the file and write the schema
+    void arrowopen(const char* path);
+
+    // add a record saved at the given time, written out a batch at a time
+    void arrowrecord(weatherRecordPtr record, time_t time);
+
+    // write the rows collected so far as a (short) batch, for --follow
+    void arrowflush();
+
+    // write the last batch and the footer, and close the file
+    void arrowclose();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _ARROWSINK_H */
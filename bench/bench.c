@@ -0,0 +1,549 @@
+/*
+ *! bench.c
+ *!
+ *! Benchmarks of the record decoding, addressing and formatting routines and of
+ *! whole listings, run over a synthetic station image: a full ring of records
+ *! whose current record is part way up memory, so listings and dataaddress()
+ *! wrap round the top of the ring as they do on a station that has been
+ *! running for a while. Built and run with "make bench".
+ *!
+ *! Each benchmark is run with more and more iterations until one run takes at
+ *! least the minimum time, and that run is reported as a line of JSON on stdout
+ *! (anything the listings print goes to /dev/null):
+ *!
+ *!     {"bench":"listRecords","version":"...","iterations":64,"seconds":0.53,
+ *!      "ns_per_op":8281250.0,"items_per_op":4079,"unit":"records","items_per_s":492561}
+ *!
+ *! version is "git describe" of the tree built, so results appended to a file
+ *! release after release can be compared.
+ *!
+ *! options:
+ *!     -t seconds      minimum time of a run (default 0.5)
+ *!     -b name         only the benchmarks whose names start with name
+ *!     -F image        use a copy of station memory (see -w) instead of the
+ *!                     synthetic image
+ *!     -w image        write the synthetic image to a file and stop (make check
+ *!                     serves it from the mock device, see mock/check.sh)
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "chstream.h"
+#include "dfile.h"
+#include "header.h"
+#include "wrecord.h"
+#include "cmdline.h"
+#include "outbuf.h"
+#include "tindex.h"
+#include "utctime.h"
+
+#ifndef BENCH_VERSION
+    #define BENCH_VERSION   "unknown"
+#endif
+
+#define ImageCurrent    (BaseAddress + 2000 * RecordSize)   // where the synthetic ring wraps
+#define ImageInterval   5                                   // minutes between records
+
+// the listings, from main.c (built with its main() renamed)
+void copymem(char* filename);
+void listRecords(int start, int end);
+void listRecordsSince(const char* since);
+
+static FILE* results;
+static double minSeconds = 0.5;
+static const char* only = NULL;
+
+static char imagePath[] = "/tmp/wsrdr-bench-XXXXXX";
+static char copyPath[] = "/tmp/wsrdr-bench-copy-XXXXXX";
+static char simSpec[sizeof(imagePath) + 32];
+
+static char image[DeviceMemorySize];    // what is being listed, as held in the file
+static int records;
+static int current;
+static time_t devtime;
+
+static volatile long blackhole;         // keeps results the compiler could drop
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   T H E   I M A G E
+//
+
+static unsigned long seed = 1;
+
+static unsigned long benchrandom() {
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    return seed >> 33;
+}
+
+static void put16(int location, unsigned int value) {
+    image[location] = value & 0xFF;
+    image[location + 1] = (value >> 8) & 0xFF;
+}
+
+// device integers are sign and magnitude
+static void putSigned(int location, int value) {
+    put16(location, (value < 0) ? (-value | 0x8000) : value);
+}
+
+static unsigned char tobcd(int v) {
+    return ((v / 10) << 4) | (v % 10);
+}
+
+//! A station that has filled its ring: every slot holds a record, the newest at
+//! ImageCurrent, dated 2026-10-16 12:00 and saved every ImageInterval minutes.
+//
+static void makeImage() {
+    memset(image, 0, sizeof(image));
+    put16(L_INTERVAL, ImageInterval);
+    put16(L_RECORDS, MaxRecords);
+    put16(L_CURRENT, ImageCurrent);
+
+    unsigned char* d = (unsigned char*) image + L_DATETIME;
+    d[0] = tobcd(26);
+    d[1] = tobcd(10);
+    d[2] = tobcd(16);
+    d[3] = tobcd(12);
+    d[4] = tobcd(0);
+
+    int rain = 30000;
+    int location = ImageCurrent;
+    for (int i = 0; i <= MaxRecords; i++) {
+        char* r = image + location;
+        r[0] = (i == 0) ? 3 : ImageInterval;
+        r[1] = 40 + benchrandom() % 20;                         // humidity inside
+        putSigned(location + 2, 180 + benchrandom() % 60);      // temperature inside
+        r[4] = 50 + benchrandom() % 50;                         // humidity outside
+        putSigned(location + 5, (int) (benchrandom() % 300) - 100);
+        put16(location + 7, 9900 + benchrandom() % 400);        // pressure
+        r[9] = benchrandom() % 40;                              // wind speed
+        put16(location + 10, benchrandom() % 80);               // gust speed
+        r[12] = benchrandom() % 16;                             // direction
+        put16(location + 13, rain);
+        r[15] = 0;
+
+        // going back in time the rain counter can only have been lower
+        rain -= (benchrandom() % 8 == 0) ? benchrandom() % 4 : 0;
+
+        location -= RecordSize;
+        if (location < BaseAddress) {
+            location += DeviceMemorySize - BaseAddress;
+        }
+    }
+}
+
+static void writeImage() {
+    int fd = mkstemp(imagePath);
+    if (fd < 0 || write(fd, image, sizeof(image)) != sizeof(image)) {
+        printf("ERROR: unable to write the benchmark image %s\n", imagePath);
+        exit(1);
+    }
+    close(fd);
+}
+
+static void saveImage(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL || fwrite(image, 1, sizeof(image), f) != sizeof(image)) {
+        printf("ERROR: unable to write image %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+static void readImage(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL || fread(image, 1, sizeof(image), f) < BaseAddress) {
+        printf("ERROR: unable to read image %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   S O U R C E S
+//
+
+// what is open, the image file (mapped, see dfile.c) or the simulator
+static enum { Closed, File, Simulator } source = Closed;
+
+static void use(int wanted) {
+    if (source == wanted) {
+        return;
+    }
+    oflush();
+    if (source != Closed) {
+        dclose();
+    }
+    dopen(wanted == File ? imagePath : simSpec);
+    source = wanted;
+
+    refreshHeader();
+    tinvalidate();
+    records = getRecordsStored();
+    current = getLocationOfCurrent();
+    devtime = utcParse(getDateTime());
+}
+
+static void useFile() {
+    use(File);
+}
+
+static void useSimulator() {
+    use(Simulator);
+}
+
+// the print specifications the formatting is measured with
+static const char* DefaultSpec = "ahHtTrpwg";           // wsrdr's default
+static const char* ExampleSpec = "uhtpwd";              // the help's example
+static const char* FullSpec    = "uaHhTtrRpwgdieyPc";   // every field
+
+static void listWith(const char* spec) {
+    recordPrintSpecification = (char*) spec;
+    rcompile(recordPrintSpecification, fieldseparator);
+}
+
+static void listFile() {
+    useFile();
+    listWith("uahHtTrpwg");
+}
+
+static void listFileNoDate() {
+    useFile();
+    listWith(DefaultSpec);
+}
+
+static void listSimulator() {
+    useSimulator();
+    listWith("uahHtTrpwg");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   B E N C H M A R K S
+//
+
+static void benchUnsigned(long n) {
+    unsigned int sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += getUnsignedInt(image + ((i * 2) & (DeviceMemorySize - 2)));
+    }
+    blackhole = sum;
+}
+
+static void benchSigned(long n) {
+    int sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += getSignedInt(image + ((i * 2) & (DeviceMemorySize - 2)));
+    }
+    blackhole = sum;
+}
+
+//! Every record index in turn, half of them above the wrap.
+//
+static void benchAddress(long n) {
+    long sum = 0;
+    int index = 0;
+    for (long i = 0; i < n; i++) {
+        sum += dataaddress(index);
+        if (++index == records) {
+            index = 0;
+        }
+    }
+    blackhole = sum;
+}
+
+//! The indices either side of where the ring wraps.
+//
+static void benchAddressWrap(long n) {
+    int wrap = (current - BaseAddress) / RecordSize;
+    int first = (wrap > 64) ? wrap - 64 : 0;
+    int last = (wrap + 64 < records) ? wrap + 64 : records;
+    long sum = 0;
+    int index = first;
+    for (long i = 0; i < n; i++) {
+        sum += dataaddress(index);
+        if (++index == last) {
+            index = first;
+        }
+    }
+    blackhole = sum;
+}
+
+static void benchRead(long n) {
+    struct weatherRecord record;
+    long sum = 0;
+    int index = 0;
+    for (long i = 0; i < n; i++) {
+        sum += rreadl(&record, dataaddress(index))->humOut;
+        if (++index == records) {
+            index = 0;
+        }
+    }
+    blackhole = sum;
+}
+
+//! Print records as a listing does, each with the one before it read.
+//
+static void benchPrint(long n, const char* spec, int verbose) {
+    struct weatherRecord pair[2];
+    char date[17];
+    rreadl(&pair[0], dataaddress(1));
+    rreadl(&pair[1], dataaddress(2));
+    pair[0].previous = &pair[1];
+    utcFormat(date, devtime);
+    usedate = date;
+
+    for (long i = 0; i < n; i++) {
+        if (verbose) {
+            rprintv(&pair[0], spec, fieldseparator, 0);
+        }
+        else {
+            rprints(&pair[0], spec, fieldseparator);
+        }
+    }
+    usedate = NULL;
+}
+
+static void benchPrintDefault(long n) {
+    benchPrint(n, DefaultSpec, false);
+}
+
+static void benchPrintExample(long n) {
+    benchPrint(n, ExampleSpec, false);
+}
+
+static void benchPrintFull(long n) {
+    benchPrint(n, FullSpec, false);
+}
+
+static void benchPrintVerbose(long n) {
+    benchPrint(n, DefaultSpec, true);
+}
+
+//! Dates of records going back through the ring, formatted from scratch and
+//! updated from the one before as listings do.
+//
+static void benchFormat(long n) {
+    char date[17];
+    time_t time = devtime;
+    for (long i = 0; i < n; i++) {
+        utcFormat(date, time);
+        time -= ImageInterval * 60;
+    }
+    blackhole = date[15];
+}
+
+static void benchUpdate(long n) {
+    struct utcDate date;
+    utcClear(&date);
+    time_t time = devtime;
+    for (long i = 0; i < n; i++) {
+        blackhole = utcUpdate(&date, time)[15];
+        time -= ImageInterval * 60;
+    }
+}
+
+static void benchList(long n) {
+    for (long i = 0; i < n; i++) {
+        listRecords(0, records - 1);
+    }
+}
+
+// a week of saved records
+#define SinceMinutes    (7 * 24 * 60)
+
+static void benchListSince(long n) {
+    char since[17];
+    utcFormat(since, devtime - SinceMinutes * 60);
+    for (long i = 0; i < n; i++) {
+        listRecordsSince(since);
+    }
+}
+
+static void benchCopy(long n) {
+    for (long i = 0; i < n; i++) {
+        copymem(copyPath);
+    }
+}
+
+//! A listing from the simulator with nothing cached, every block read through
+//! chstream as it is from a station.
+//
+static void benchListSimulator(long n) {
+    for (long i = 0; i < n; i++) {
+        uflush();
+        refreshHeader();
+        listRecords(0, records - 1);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   R U N N I N G
+//
+
+static long itemsRecords() {
+    return records;
+}
+
+static long itemsSince() {
+    return tsearch(SinceMinutes) - 2;
+}
+
+static long itemsCopied() {
+    return current + RecordSize;
+}
+
+struct benchmark {
+    const char* name;
+    void        (*setup)();
+    void        (*run)(long n);
+    long        (*items)();             // items handled each iteration, NULL for 1
+    const char* unit;
+};
+
+static const struct benchmark benchmarks[] = {
+    { "getUnsignedInt",         useFile,        benchUnsigned,      NULL,           "calls" },
+    { "getSignedInt",           useFile,        benchSigned,        NULL,           "calls" },
+    { "dataaddress",            useFile,        benchAddress,       NULL,           "calls" },
+    { "dataaddress.wrap",       useFile,        benchAddressWrap,   NULL,           "calls" },
+    { "rreadl",                 useFile,        benchRead,          NULL,           "records" },
+    { "rprints.default",        useFile,        benchPrintDefault,  NULL,           "rows" },
+    { "rprints.example",        useFile,        benchPrintExample,  NULL,           "rows" },
+    { "rprints.full",           useFile,        benchPrintFull,     NULL,           "rows" },
+    { "rprintv.default",        useFile,        benchPrintVerbose,  NULL,           "rows" },
+    { "utcFormat",              useFile,        benchFormat,        NULL,           "dates" },
+    { "utcUpdate",              useFile,        benchUpdate,        NULL,           "dates" },
+    { "listRecords",            listFile,       benchList,          itemsRecords,   "records" },
+    { "listRecords.nodate",     listFileNoDate, benchList,          itemsRecords,   "records" },
+    { "listRecordsSince",       listFile,       benchListSince,     itemsSince,     "records" },
+    { "copymem",                useFile,        benchCopy,          itemsCopied,    "bytes" },
+    { "listRecords.simulator",  listSimulator,  benchListSimulator, itemsRecords,   "records" },
+};
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void runBenchmark(const struct benchmark* b) {
+    b->setup();
+    b->run(1);      // warm up, and build anything built on first use
+
+    long n = 1;
+    double elapsed;
+    for (;;) {
+        double start = now();
+        b->run(n);
+        oflush();
+        elapsed = now() - start;
+        if (elapsed >= minSeconds) {
+            break;
+        }
+        // aim a little past the minimum from what this run took
+        n = (elapsed > minSeconds / 100) ? (long) (n * 1.2 * minSeconds / elapsed) + 1 : n * 10;
+    }
+
+    long items = (b->items != NULL) ? b->items() : 1;
+    fprintf(results, "{\"bench\":\"%s\",\"version\":\"%s\",\"iterations\":%ld,\"seconds\":%.3f,"
+            "\"ns_per_op\":%.1f,\"items_per_op\":%ld,\"unit\":\"%s\",\"items_per_s\":%.0f}\n",
+            b->name, BENCH_VERSION, n, elapsed, elapsed * 1e9 / n, items, b->unit, n * items / elapsed);
+    fflush(results);
+}
+
+static void cleanup() {
+    unlink(imagePath);
+    unlink(copyPath);
+}
+
+int main(int argc, char** argv) {
+    const char* imageFile = NULL;
+    const char* saveFile = NULL;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:b:F:w:h")) != -1) {
+        switch (c) {
+            case 't':   minSeconds = atof(optarg);  break;
+            case 'b':   only = optarg;              break;
+            case 'F':   imageFile = optarg;         break;
+            case 'w':   saveFile = optarg;          break;
+            default:
+                printf("usage: %s [-t seconds] [-b name] [-F image] [-w image]\n", argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+
+    if (saveFile != NULL) {
+        makeImage();
+        saveImage(saveFile);
+        exit(0);
+    }
+
+    if (imageFile != NULL) {
+        readImage(imageFile);
+    }
+    else {
+        makeImage();
+    }
+    writeImage();
+    atexit(cleanup);
+    snprintf(simSpec, sizeof(simSpec), ":sim:%s,update=0,interval=0", imagePath);
+
+    int fd = mkstemp(copyPath);
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    // results go where stdout did, the listings to /dev/null
+    results = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    if (results == NULL || null < 0 || dup2(null, STDOUT_FILENO) < 0) {
+        fprintf(stderr, "ERROR: unable to redirect the listings\n");
+        exit(1);
+    }
+    close(null);
+
+    for (int i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (only == NULL || strncmp(benchmarks[i].name, only, strlen(only)) == 0) {
+            runBenchmark(&benchmarks[i]);
+        }
+    }
+
+    oflush();
+    if (source != Closed) {
+        dclose();
+    }
+    fclose(results);
+    return 0;
+}
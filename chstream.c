@@ -7,6 +7,9 @@
 //! cache of data read. The uflush() and uFoce() methods can be used to make reads physical,
 //! uflush() affecting the whole cache and uforce() being used on parts of it.
 //!
+//! The cache can be kept in a file between runs (uopencache()), in which case only the
+//! blocks the device can have changed since the last run are read again.
+//!
 //! V0.1
 //!
 //! Copyright (C) J. Whurr 2010
@@ -33,31 +36,125 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 
 #include "config.h"
 #include "chstream.h"
 #include "usbdrv.h"
+#include "outbuf.h"
+#include "timeline.h"
+
+#define CacheMagic  "WSRDRC01"
+
+// The cached device image with its block validity and the header values it was
+// last seen with. Held in memory, or mapped from a cache file (see uopencache())
+// so that it survives from one run to the next.
+struct CACHEIMAGE {
+    char            magic[8];
+    char            snapshot;                   // true when the values below are known
+    unsigned int    current;                    // L_CURRENT
+    unsigned int    records;                    // L_RECORDS
+    unsigned char   datetime[5];                // L_DATETIME
+    char            validflag[DeviceMemorySize / ReadBufferSize];
+    char            cache[DeviceMemorySize];
+};
 
+static struct CACHEIMAGE memoryimage;
+static struct CACHEIMAGE* image = &memoryimage;
+static int cachefd = -1;
 
-static char cache[DeviceMemorySize];
-static char validflag[DeviceMemorySize / ReadBufferSize];
+static char* cache = memoryimage.cache;
+static char* validflag = memoryimage.validflag;
 
 static int lastreadaddress = 0xFFFF;
 static int devaddress = 0;
 static char streambuffer[ReadBufferSize];
 static int error = 0;
+static struct streamStats statistics;
+
+// the device, unless ubackend() has said otherwise
+static const struct usbBackend* backend = &usbDevice;
+
+//! Read blocks from the given source instead of the usb device. Must be called
+//! before the device is opened.
+//
+void ubackend(const struct usbBackend* source) {
+    backend = source;
+}
+
+//! Opens whatever blocks are read from, on the timeline (see timeline.h).
+//
+static void uopenbackend() {
+    uint64_t started = timing ? tlnow() : 0;
+    backend->open();
+    tlspan("open", "device", started, NULL, 0);
+}
 
 //! Opens the usb device and sets up the internal cache
 //
 void uopen() {
-    openUSBDevice();
+    uopenbackend();
     uflush();
 }
 
-//! Closes the usb device
+//! Opens the usb device keeping the cache in the named file, so that blocks read
+//! on earlier runs are only read again if the device can have written to them
+//! since (see urefresh()). The file is locked while it is in use.
+//
+void uopencache(const char* filename) {
+    cachefd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (cachefd < 0) {
+        printf("Error: could not open cache file %s\n", filename);
+        exit(1);
+    }
+    flock(cachefd, LOCK_EX);
+
+    struct CACHEIMAGE* mapped = NULL;
+    if (ftruncate(cachefd, sizeof(struct CACHEIMAGE)) == 0) {
+        mapped = mmap(NULL, sizeof(struct CACHEIMAGE), PROT_READ | PROT_WRITE, MAP_SHARED, cachefd, 0);
+    }
+    if (mapped == NULL || mapped == MAP_FAILED) {
+        printf("Error: could not map cache file %s\n", filename);
+        exit(1);
+    }
+
+    image = mapped;
+    cache = image->cache;
+    validflag = image->validflag;
+
+    // anything that isn't one of ours starts out empty
+    if (memcmp(image->magic, CacheMagic, sizeof(image->magic)) != 0) {
+        image->snapshot = false;
+        uflush();
+        memcpy(image->magic, CacheMagic, sizeof(image->magic));
+    }
+
+    uopenbackend();
+    urefresh();
+}
+
+//! Closes the usb device (and the cache file)
 //
 void uclose() {
-    _close_readw();
+    backend->close();
+
+    if (cachefd >= 0) {
+        munmap(image, sizeof(struct CACHEIMAGE));
+        close(cachefd);
+        cachefd = -1;
+        image = &memoryimage;
+        cache = image->cache;
+        validflag = image->validflag;
+    }
+}
+
+//! The counts of cache hits and misses and of the blocks read to fill it.
+//
+const struct streamStats* ustats() {
+    return &statistics;
 }
 
 //! Returns the internal error code (0 = no error)
@@ -81,11 +178,131 @@ void uflush() {
     }
 }
 
+//! Marks the blocks holding size bytes from location as needing a physical read.
+//
+void uinvalidate(int location, int size) {
+    for(int block = ReadAddress(location); block < location + size && block < DeviceMemorySize; block += ReadBufferSize) {
+        validflag[block / ReadBufferSize] = false;
+    }
+}
+
+// 2 byte device integer from the cache
+static unsigned int ucached(int location) {
+    return (unsigned char) cache[location] + ((unsigned int)(unsigned char) cache[location + 1] << 8);
+}
+
+//! Works out from the movement of the current record pointer (now in the cache)
+//! which cached records the device can have written to since the last look: the
+//! record that was current (it is rewritten until it is saved) and every record
+//! saved after it. Only those are marked for a physical read. If the movement
+//! can't be accounted for (no earlier values, the device was cleared, or the ring
+//! has gone all the way round) the whole record area is flushed.
+//!
+//! Returns the number of records saved since the last look, -1 if flushed.
+//
+static int uadvance() {
+    unsigned int current = ucached(L_CURRENT);
+    unsigned int records = ucached(L_RECORDS);
+    unsigned char* datetime = (unsigned char*) cache + L_DATETIME;
+
+    int saved = -1;
+    if (image->snapshot && current >= BaseAddress && current < DeviceMemorySize
+            && records >= image->records
+            && memcmp(datetime, image->datetime, sizeof(image->datetime)) >= 0) {
+        // distance round the ring from the old current record to the new one
+        int distance = current - image->current;
+        if (distance < 0) {
+            distance += DeviceMemorySize - BaseAddress;
+        }
+        saved = distance / RecordSize;
+        if (saved > MaxRecords) {
+            saved = -1;
+        }
+    }
+
+    if (saved < 0) {
+        uinvalidate(BaseAddress, DeviceMemorySize - BaseAddress);
+    }
+    else {
+        int location = image->current;
+        for(int i = 0; i <= saved; i++) {
+            uforce(location);
+            location += RecordSize;
+            if (location >= DeviceMemorySize) {
+                location = BaseAddress;
+            }
+        }
+    }
+
+    image->current = current;
+    image->records = records;
+    memcpy(image->datetime, datetime, sizeof(image->datetime));
+    image->snapshot = true;
+
+    return saved;
+}
+
+//! Re-reads the header blocks and marks the records the device can have written
+//! to since the last refresh for a physical read (see uadvance()).
+//!
+//! Returns the number of records saved since the last refresh, -1 if flushed.
+//
+int urefresh() {
+    uinvalidate(0, BaseAddress);
+    ufetch(0, L_DATETIME + sizeof(image->datetime));
+
+    return uadvance();
+}
+
+//! A cheaper urefresh() for polling: only the block holding L_CURRENT and
+//! L_RECORDS is read, and the one with the date & time only if the current
+//! record has moved. That makes a poll with nothing new one block transfer.
+//! The station keeps rewriting the current record until it is saved, so its
+//! block is marked for reading again then too (as uadvance() marks it).
+//!
+//! Returns the number of records saved since the last poll, -1 if flushed.
+//
+static int upollheader() {
+    uforce(L_CURRENT);
+    uforce(L_RECORDS);
+    ufetch(L_RECORDS, 2);
+    ufetch(L_CURRENT, 2);
+
+    if (image->snapshot && ucached(L_CURRENT) == image->current && ucached(L_RECORDS) == image->records) {
+        uinvalidate(image->current, RecordSize);
+        return 0;
+    }
+
+    uforce(L_DATETIME);
+    ufetch(L_DATETIME, sizeof(image->datetime));
+    return uadvance();
+}
+
+//! Polls the header for records saved (see upollheader()), on the timeline.
+//
+int upoll() {
+    uint64_t started = timing ? tlnow() : 0;
+    int saved = upollheader();
+    tlspan("poll", "header", started, "saved", saved);
+    return saved;
+}
+
+//! Takes the header values a listing was made from as the ones the next poll
+//! compares with, so the records saved since that listing are the ones found
+//! new (rather than those since a poll taken after it).
+//
+void ubaseline(unsigned int current, unsigned int records, const char* datetime) {
+    image->current = current;
+    image->records = records;
+    memcpy(image->datetime, datetime, sizeof(image->datetime));
+    image->snapshot = true;
+}
+
 //! Does a useek and forces a physical read of the location
 //
 void uforce(int location) {
     useek(location);
-    validflag[ReadAddress(location)] = false;
+    validflag[location / ReadBufferSize] = false;
 }
 
 //! Seeks to the start of device memory (equivalent tto useek(0))
@@ -94,6 +311,228 @@ void urewind() {
     useek(0);
 }
 
+//! Called by the usb driver as each block of a batch arrives. Short reads are
+//! left invalid so that ugetc() retries them (and reports the error).
+//
+static void ustore(void* context, long location, char* data, int bytes) {
+    if (bytes < ReadBufferSize) {
+        return;
+    }
+    memcpy(cache + location, data, ReadBufferSize);
+    validflag[location / ReadBufferSize] = true;
+}
+
+//! Reads a batch of blocks into the cache, returning the number not read in full.
+//
+static int ureadblocks(const long* locations, int count) {
+    uint64_t started = timing ? tlnow() : 0;
+    int failed = count - backend->readBlocks(locations, count, ustore, NULL);
+    tlspan("read blocks", "chstream", started, "blocks", count);
+
+    statistics.batches++;
+    statistics.blocks += count;
+    statistics.failed += failed;
+    return failed;
+}
+
+// the blocks of the ring of records
+#define RingFirst       (BaseAddress / ReadBufferSize)
+#define RingBlocks      ((DeviceMemorySize - BaseAddress) / ReadBufferSize)
+
+// the last run of blocks ufetch() was asked for in the ring, which way the runs
+// before it have been going (1 up memory, -1 down, 0 neither) and how many
+// blocks to read ahead in that direction
+static struct {
+    int     first;
+    int     last;
+    int     direction;
+    int     blocks;
+} readahead = { -1, -1, 0, 0 };
+
+//! The block step blocks on from block, round the ring.
+//
+static int ustep(int block, int step) {
+    block += step;
+    if (block < RingFirst) {
+        block += RingBlocks;
+    }
+    else if (block >= RingFirst + RingBlocks) {
+        block -= RingBlocks;
+    }
+    return block;
+}
+
+//! Whether block holds stored records, as far as the cached header says. Going
+//! back round the ring from the current record, records are stored for L_RECORDS
+//! records; anything further back (or past the current record) is old data.
+//
+static int uinrecords(int block) {
+    if (validflag[0] != true) {
+        return true;    // the header isn't known, so neither is the end
+    }
+    int current = ucached(L_CURRENT) / ReadBufferSize;
+    if (current < RingFirst || current >= RingFirst + RingBlocks) {
+        return true;
+    }
+    int back = current - block;
+    if (back < 0) {
+        back += RingBlocks;
+    }
+    return back <= (int) (ucached(L_RECORDS) * RecordSize / ReadBufferSize) + 1;
+}
+
+//! Follows the runs of blocks asked for: a run next to or overlapping the last
+//! one carries on in its direction and doubles the read-ahead (up to
+//! ReadAheadBlocks), a run within the last changes nothing, and anything else is
+//! random access, which stops reading ahead. Listings go down memory from the
+//! current record (and wrap round to the top of the ring), copies go up.
+//
+static void ufollow(int first, int last) {
+    int direction = 0;
+
+    if (readahead.first < 0) {
+        direction = 0;
+    }
+    else if (first >= readahead.first && last <= readahead.last) {
+        return;
+    }
+    else if (first == ustep(readahead.last, 1) || (first >= readahead.first && first <= readahead.last)) {
+        direction = 1;
+    }
+    else if (last == ustep(readahead.first, -1) || (last >= readahead.first && last <= readahead.last)) {
+        direction = -1;
+    }
+
+    if (direction == 0) {
+        readahead.blocks = 0;
+    }
+    else if (direction == readahead.direction) {
+        readahead.blocks *= 2;
+        if (readahead.blocks > ReadAheadBlocks) {
+            readahead.blocks = ReadAheadBlocks;
+        }
+    }
+    else {
+        readahead.blocks = (ReadAheadBlocks < 2) ? ReadAheadBlocks : 2;
+    }
+    readahead.direction = direction;
+    readahead.first = first;
+    readahead.last = last;
+}
+
+//! Adds the blocks to read ahead of the last run to pending, once the reads
+//! have caught up with what was read ahead before (the next block along isn't
+//! cached). Returns the new count.
+//
+static int uaddahead(long* pending, int count) {
+    if (readahead.direction == 0 || readahead.blocks == 0) {
+        return count;
+    }
+
+    int edge = (readahead.direction > 0) ? readahead.last : readahead.first;
+    int block = ustep(edge, readahead.direction);
+    if (validflag[block] == true) {
+        return count;
+    }
+
+    for (int i = 0; i < readahead.blocks && uinrecords(block); i++) {
+        if (validflag[block] != true) {
+            pending[count++] = (long) block * ReadBufferSize;
+            statistics.readAhead++;
+        }
+        block = ustep(block, readahead.direction);
+    }
+    return count;
+}
+
+//! Makes sure the blocks holding size bytes from location are in the cache. Any
+//! that are missing are requested from the device as one batch rather than one
+//! round trip at a time as ugetc() finds them.
+//!
+//! Reads in the ring that follow on from the ones before (a listing going back
+//! through the records, a copy going forwards) also read the blocks after them
+//! in the same direction, more of them the longer the run goes on (see
+//! ufollow()), so that by the time they are asked for they are already cached.
+//!
+//! Returns the number of blocks asked for that could not be read.
+//
+int ufetch(int location, int size) {
+    static long pending[DeviceMemorySize / ReadBufferSize + ReadAheadBlocks];
+    int count = 0;
+
+    int end = location + size;
+    if (end > DeviceMemorySize) {
+        end = DeviceMemorySize;
+    }
+
+    for(int block = ReadAddress(location); block < end; block += ReadBufferSize) {
+        if (validflag[block / ReadBufferSize] != true) {
+            pending[count++] = block;
+        }
+    }
+    int asked = count;
+
+    // the header is read in between the records, so it is left out of the runs
+    if (ReadAheadBlocks > 0 && location >= BaseAddress && end > location) {
+        ufollow(location / ReadBufferSize, (end - 1) / ReadBufferSize);
+        count = uaddahead(pending, count);
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    ureadblocks(pending, count);
+
+    // only the blocks asked for count as failures
+    int failed = 0;
+    for(int i = 0; i < asked; i++) {
+        if (validflag[pending[i] / ReadBufferSize] != true) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+static long wanted[DeviceMemorySize / ReadBufferSize];
+static char wantedflag[DeviceMemorySize / ReadBufferSize];
+static int nwanted = 0;
+
+//! Notes the blocks holding size bytes from location that aren't cached, for
+//! ufetchwanted() to read along with any others wanted.
+//
+void uwant(int location, int size) {
+    int end = location + size;
+    if (end > DeviceMemorySize) {
+        end = DeviceMemorySize;
+    }
+
+    for(int block = ReadAddress(location); block < end; block += ReadBufferSize) {
+        if (validflag[block / ReadBufferSize] != true && !wantedflag[block / ReadBufferSize]) {
+            wantedflag[block / ReadBufferSize] = true;
+            wanted[nwanted++] = block;
+        }
+    }
+}
+
+//! Reads every block noted by uwant() since the last call as one batch, so a
+//! block wanted more than once is read once. Returns the number of blocks that
+//! could not be read.
+//
+int ufetchwanted() {
+    int count = nwanted;
+    if (count == 0) {
+        return 0;
+    }
+
+    for(int i = 0; i < count; i++) {
+        wantedflag[wanted[i] / ReadBufferSize] = false;
+    }
+    nwanted = 0;
+
+    return ureadblocks(wanted, count);
+}
+
 //! Returns the next byte of data from the stream
 //
 char ugetc() {
@@ -111,13 +550,21 @@ char ugetc() {
     // see if its in the cache of device memory
     if (validflag[lastreadaddress / ReadBufferSize] == true) {
         //printf("DEBUG: address %04x in cache\n", devaddress);
+            statistics.hits++;
             return (char) cache[devaddress++];
     }
+    statistics.misses++;
 
     //printf("DEBUG: address %04x not in cache, reading buffer @ %04x\n", devaddress, lastreadaddress);
 
     // isn't in cache so we have to get it
-    int bytesread = readBytesFromUSB(streambuffer, lastreadaddress);
+    uint64_t started = timing ? tlnow() : 0;
+    int bytesread = backend->readBytes(streambuffer, lastreadaddress);
+    tlspan("read block", "chstream", started, "location", lastreadaddress);
+    statistics.blocks++;
+    if (bytesread < ReadBufferSize) {
+        statistics.failed++;
+    }
     if (bytesread < bufferoffset) {
         error = EOF;
         return -1;
@@ -136,9 +583,14 @@ char ugetc() {
 int uread(char* buffer, int size) {
     //printf("DEBUG: uread(buffer, %d) @ %04x\n", size, devaddress);
     int bytesread = 0;
+
+    // get whatever isn't cached in one go, ugetc() then finds it all in the cache
+    ufetch(devaddress, size);
+
     for(int i = 0; i < size; i++) {
         buffer[i] = ugetc();
         if (error == EOF) {
+            oflush();
             printf("ERROR: ugetc() reported EOF at location %04x\n", devaddress);
             return bytesread;
         }
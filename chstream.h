@@ -3,17 +3,42 @@
 #ifndef _CHSTREAM_H
 #define	_CHSTREAM_H
 
+#include "usbdrv.h"
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
+void ubackend(const struct usbBackend* source);
 void uopen();
+void uopencache(const char* filename);
+void uclose();
 int uerror();
 void uflush();
+void uinvalidate(int location, int size);
+int urefresh();
+int upoll();
+void ubaseline(unsigned int current, unsigned int records, const char* datetime);
+void uwant(int location, int size);
+int ufetchwanted();
+void uforce(int location);
 void useek(int location);
 void urewind();
 char ugetc();
 int uread(char* buffer, int size);
+int ufetch(int location, int size);
+
+// how reads were served, for --stats
+struct streamStats {
+    long        hits;               // ugetc() calls finding their block cached
+    long        misses;             // ...and not, so reading it there and then
+    long        batches;            // batches of missing blocks read in one go
+    long        blocks;             // blocks asked of the device, by either way
+    long        failed;             // of which weren't read in full
+    long        readAhead;          // of which were read ahead of being asked for
+};
+
+const struct streamStats* ustats();
 
 #ifdef	__cplusplus
 }
@@ -30,9 +30,13 @@
 #include <signal.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <getopt.h>
 
 #include "config.h"
 #include "cmdline.h"
+#include "wrecord.h"
+#include "aggregate.h"
+#include "stats.h"
 
 unsigned int memoryDumpStart;
 unsigned int memoryDumpEnd;
@@ -45,6 +49,15 @@ struct OPTIONS options;
 
 char * recordPrintSpecification = "ahHtTrpwg";
 char * cmdFilename;
+char * cacheFilename;
+char * stateFilename;
+int aggregatePeriod;
+char * outputName;
+int followSeconds = FollowSeconds;
+char * socketName;
+char * usbTraceName;
+int statsFormat = StatsText;
+char * timelineName;
 
 static int parseMemoryLocations(char*);
 static int parseRecordRange(char* string);
@@ -52,11 +65,21 @@ static char * validatePrintSpecification(char*);
 
 static int noRecordRange = 0;
 
+// long options, given values past any option character
+enum { optFollow = 256, optStats, optTrace };
+
+static const struct option longOptions[] = {
+    { "follow", optional_argument, NULL, optFollow },
+    { "stats", optional_argument, NULL, optStats },
+    { "trace", required_argument, NULL, optTrace },
+    { NULL, 0, NULL, 0 }
+};
+
 void read_arguments(int argc, char **argv) {
     int c;
     int done = 0;
 
-    while ((done == 0) && ((c = getopt(argc, argv, "hHvm:p:r:s:w:F:S:")) != -1)) {	// JW01, added S
+    while ((done == 0) && ((c = getopt_long(argc, argv, "hHvm:o:p:r:s:w:A:C:D:F:I:S:T:", longOptions, NULL)) != -1)) {	// JW01, added S
         switch (c) {
             case 'm':
                 options.dumpMemory = 1;
@@ -91,6 +114,16 @@ void read_arguments(int argc, char **argv) {
                 done = 1;
                 break;
 
+            case 'C':
+                options.cacheFile = 1;
+                cacheFilename = optarg;
+                break;
+
+            case 'D':
+                options.serve = 1;
+                socketName = optarg;
+                break;
+
             case 'H':
                 options.dumpHeader = 1;
                 break;
@@ -126,6 +159,60 @@ void read_arguments(int argc, char **argv) {
                 dateSince = optarg;
                 break;
 
+            case 'I':
+                options.incremental = 1;
+                stateFilename = optarg;
+                break;
+
+            case 'o':
+                options.output = 1;
+                outputName = optarg;
+                break;
+
+            case 'A':
+                options.aggregate = 1;
+                if ((aggregatePeriod = aggregateperiod(optarg)) < 0) {
+                    options.showHelp = 1;
+                    return;
+                }
+                break;
+
+            case optFollow:
+                options.follow = 1;
+                if (optarg != NULL) {
+                    char* end;
+                    followSeconds = strtol(optarg, &end, 10);
+                    if (*end != '\0' || followSeconds < 1) {
+                        options.showHelp = 1;
+                        return;
+                    }
+                }
+                break;
+
+            case optStats:
+                options.stats = 1;
+                if (optarg == NULL || strcmp(optarg, "text") == 0) {
+                    statsFormat = StatsText;
+                }
+                else if (strcmp(optarg, "json") == 0) {
+                    statsFormat = StatsJson;
+                }
+                else {
+                    options.showHelp = 1;
+                    return;
+                }
+                break;
+
+            case optTrace:
+                options.timeline = 1;
+                timelineName = optarg;
+                break;
+
+            case 'T':
+                options.usbTrace = 1;
+                usbTraceName = optarg;
+                break;
+
             case 'S':
                     options.fieldseparator = 1;
                     fieldseparator = optarg;
@@ -255,13 +342,5 @@ static int parseMemoryLocations(char* string) {
 }
 
 static char * validatePrintSpecification(char* spec) {
-    int i = 0;
-    char* ptr = spec;
-
-    for(i = 0; i < strlen(spec); i++) {
-        if (strchr("ahHtTrRpwgdDuUi", *ptr++) == NULL) {
-            return NULL;
-        }
-    }
-    return spec;
+    return rvalidspec(spec) ? spec : NULL;
 }
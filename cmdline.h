@@ -27,6 +27,15 @@ extern "C" {
         unsigned int inputFromFile          : 1;    // -F "filename"
         unsigned int verbose                : 1;    // -v
 		unsigned int fieldseparator			: 1;	// -S "field separator string"
+        unsigned int cacheFile              : 1;    // -C "filename"
+        unsigned int incremental            : 1;    // [-r...] -I "state filename"
+        unsigned int aggregate              : 1;    // [-r...] -A hour|day|week
+        unsigned int output                 : 1;    // [-r...] -o "kind:path"
+        unsigned int follow                 : 1;    // [-r...] --follow[=seconds]
+        unsigned int serve                  : 1;    // -D "socket path"
+        unsigned int usbTrace               : 1;    // -T "trace filename"
+        unsigned int stats                  : 1;    // --stats[=text|json]
+        unsigned int timeline               : 1;    // --trace "json filename"
         unsigned int untilFirstRecord       : 1;    // internal flag
     };
 
@@ -34,6 +43,15 @@ extern "C" {
 
     extern struct OPTIONS options;
     extern char * cmdFilename;
+    extern char * cacheFilename;
+    extern char * stateFilename;
+    extern int aggregatePeriod;
+    extern char * outputName;
+    extern int followSeconds;
+    extern char * socketName;
+    extern char * usbTraceName;
+    extern int statsFormat;
+    extern char * timelineName;
 
     extern char * recordPrintSpecification;
     extern unsigned int memoryDumpStart;
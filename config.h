@@ -9,10 +9,40 @@
                      // the size of a physical read, also 'block' of cache
 #define ReadBufferSize	    (0x20)
 
+                     // block reads the usb driver keeps in flight. The WH1081 answers one
+                     // read command at a time, only raise this for firmware that queues them
+#ifndef TransferDepth
+#define TransferDepth       1
+#endif
+
+                     // most blocks chstream reads ahead of a sequential run of reads
+                     // (0 for none), see ufetch()
+#ifndef ReadAheadBlocks
+#define ReadAheadBlocks     16
+#endif
+
 #define RecordSize	        16              // size of weather-station data record
 
 #define MaxRecords          (((DeviceMemorySize - BaseAddress) / RecordSize) - 1)
 
+                     // header locations chstream needs to follow the ring of records
+#define	L_INTERVAL	        (0x010)         // storage interval
+#define	L_RECORDS	        (0x01B)         // number of records stored on device
+#define L_CURRENT	        (0x01E)         // memory address of current record
+#define	L_DATETIME	        (0x02B)         // address of device date & time (5 bytes bcd)
+
+                     // bytes of record output collected before they are written out
+#define OutputBufferSize    (64 * 1024)
+
+                     // seconds between looks at the device header with --follow
+#define FollowSeconds       10
+
+                     // least seconds between a server's looks for new records
+#define ServerPollSeconds   1
+
+                     // records held in a -o shm: ring
+#define ShmSlots            1024
+
 #define DumpWidth           16              // width of hex dump in (16 = 16 charcters of data)
 #define	false				(1==0)
 #define true				(1==1)
@@ -2,6 +2,8 @@
  *! dfile.c
  *! Provides a file-like interface to the underlying data irrespective of
  *! the actual storage. Layered on top of the chstream.h interface.
+ *! Files holding a copy of device memory are mapped into memory once when
+ *! opened, so reads from them are plain copies (or see dpointer()).
  *!
  *! V0.11
  *!
@@ -30,20 +32,37 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "chstream.h"
+#include "dfile.h"
+#include "server.h"
+#include "simdev.h"
+#include "usbtrace.h"
 
 //#define _DEBUG
 
 typedef enum HANDLE {
     NONE = 0,
     DEVICE,
-    CFILE
+    CFILE,
+    MFILE,
+    SOCKET
 } HANDLE;
 
 HANDLE handle;
 FILE* cfile = NULL;
 
+// a file image mapped into memory (MFILE)
+const char* mfile = NULL;
+long mfilesize = 0;
+char* cachefile = NULL;
+
+static struct fileStats statistics;
+
 
 #ifdef _DEBUG
 void dump(char* data, int location, int size) {
@@ -60,26 +79,83 @@ void dump(char* data, int location, int size) {
     #define debug(d, l, s)	;
 #endif
 
-//! Open the file that holds the data, either the actual device (:usb:) or a file
-//! holding a copy of weatherstation memory.
+//! Keep the device cache in the given file between runs (see chstream.c). Must be
+//! called before the device is opened.
+//!
+void dcache(char* filename) {
+    cachefile = filename;
+}
+
+//! Open the file that holds the data, either the actual device (:usb:), a
+//! simulated one (:sim:image..., see simdev.h), a recording of one played back
+//! (:replay:trace..., see usbtrace.h), a wsrdr serving it (:sock:path, see
+//! server.h) or a file holding a copy of weatherstation memory.
 //!
 int dopen(char* filename) {
-    if (strcmp(":usb:", filename) == 0) {
-        uopen();			//openUSBDevice();
+    if (strncmp(":sock:", filename, 6) == 0) {
+        sopen(filename + 6);
+        handle = SOCKET;
+        return 1;
+    }
+
+    int standin = (strncmp(":sim:", filename, 5) == 0);
+    if (standin) {
+        simconfigure(filename + 5);
+        ubackend(&simDevice);
+    }
+    else if (strncmp(":replay:", filename, 8) == 0) {
+        replayconfigure(filename + 8);
+        ubackend(&replayDevice);
+        standin = 1;
+    }
+
+    if (standin || strcmp(":usb:", filename) == 0) {
+        if (cachefile != NULL) {
+            uopencache(cachefile);
+        }
+        else {
+            uopen();			//openUSBDevice();
+        }
         handle = DEVICE;
         return 1;
     }
 
+    // map the image so reads are just copies, using stdio for anything that
+    // can't be mapped (pipes etc.)
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (image != MAP_FAILED) {
+                close(fd);
+                mfile = image;
+                mfilesize = st.st_size;
+                handle = MFILE;
+                return 1;
+            }
+        }
+        close(fd);
+    }
+
     cfile = fopen(filename, "rb");
     handle = CFILE;
-    return cfile >= 0;
+    return cfile != NULL;
 }
 
-//! Read a block of the file into the specified buffer.
+//! Returns a pointer straight into the data for size bytes at location when it
+//! is held in memory (a mapped file), otherwise NULL and dread() has to be used.
 //
-// **JW01** changed 2nd parameter from int to long
+const char* dpointer(long location, int size) {
+    if (handle == MFILE && location >= 0 && location + size <= mfilesize) {
+        return mfile + location;
+    }
+    return NULL;
+}
+
+//! Read from whatever is open.
 //
-int dread(char* buffer, long location, int size) {
+static int dreadfrom(char* buffer, long location, int size) {
     switch(handle) {
         case NONE:
             printf("Error: no device has been opened, use dopen()\n");
@@ -96,10 +172,44 @@ int dread(char* buffer, long location, int size) {
             int read = fread(buffer, 1, size, cfile);
             debug(buffer, location, size);
             return read;
+
+        case SOCKET:
+            return sread(buffer, location, size);
+
+        case MFILE:
+            if (location < 0 || location >= mfilesize) {
+                return 0;
+            }
+            if (location + size > mfilesize) {
+                size = mfilesize - location;
+            }
+            memcpy(buffer, mfile + location, size);
+            debug(buffer, location, size);
+            return size;
     }
     return -1;
 }
 
+//! Read a block of the file into the specified buffer, counting it for dstats().
+//
+// **JW01** changed 2nd parameter from int to long
+//
+int dread(char* buffer, long location, int size) {
+    int bytes = dreadfrom(buffer, location, size);
+
+    statistics.calls++;
+    if (bytes > 0) {
+        statistics.bytes += bytes;
+    }
+    return bytes;
+}
+
+//! The count of dread() calls and the bytes they returned.
+//
+const struct fileStats* dstats() {
+    return &statistics;
+}
+
 //! Pass-through to the relevant flush routine. For the physical device this
 //! causes the underlying chstream cache to be flushed.
 //
@@ -115,6 +225,55 @@ void dflush() {
 
         case CFILE:
             fflush(cfile);
+            break;
+
+        case MFILE:
+        case SOCKET:
+            break;
+    }
+}
+
+//! Checks the device for records saved since the last check (see upoll()), so
+//! the blocks they are in get read again. A file doesn't change, so never has any.
+//!
+//! Returns the number of records saved, -1 if they can't be accounted for.
+//
+int dpoll() {
+    if (handle == DEVICE) {
+        return upoll();
+    }
+    if (handle == SOCKET) {
+        return spoll();
+    }
+    return 0;
+}
+
+//! Start dpoll() from the header values a listing was read with (L_CURRENT,
+//! L_RECORDS and the L_DATETIME bytes), so nothing saved after it is missed.
+//
+void dbaseline(unsigned int current, unsigned int records, const char* datetime) {
+    if (handle == DEVICE) {
+        ubaseline(current, records, datetime);
+    }
+    else if (handle == SOCKET) {
+        sbaseline(current);
+    }
+}
+
+//! Note the blocks holding size bytes from location for dfetch() to read, along
+//! with any others noted, in one go. Only the device needs it.
+//
+void dwant(long location, int size) {
+    if (handle == DEVICE) {
+        uwant(location, size);
+    }
+}
+
+//! Read the blocks noted by dwant().
+//
+void dfetch() {
+    if (handle == DEVICE) {
+        ufetchwanted();
     }
 }
 
@@ -124,5 +283,16 @@ void dclose() {
     if (handle == CFILE) {
         fclose(cfile);
     }
+    else if (handle == MFILE) {
+        munmap((void*) mfile, mfilesize);
+        mfile = NULL;
+        mfilesize = 0;
+    }
+    else if (handle == DEVICE) {
+        uclose();
+    }
+    else if (handle == SOCKET) {
+        sclose();
+    }
     handle = NONE;
 }
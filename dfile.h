@@ -8,10 +8,24 @@
 extern "C" {
 #endif
 
+void dcache(char* filename);
 int dopen(char* filename);
 int dread(char* buffer, long location, int size);
+const char* dpointer(long location, int size);
+int dpoll();
+void dbaseline(unsigned int current, unsigned int records, const char* datetime);
+void dwant(long location, int size);
+void dfetch();
 void dclose();
 
+// what dread() was asked for, for --stats
+struct fileStats {
+    long        calls;
+    long long   bytes;              // bytes it returned
+};
+
+const struct fileStats* dstats();
+
 #ifdef	__cplusplus
 }
 #endif
@@ -30,17 +30,7 @@
 #include "config.h"
 #include "header.h"
 #include "dfile.h"
-
-
-//////////////////////////////////////////////////////////////////////////////////////////////
-//
-//   M A C R O S
-//
-
-#define	L_INTERVAL	(0x010)				// storage interval
-#define	L_RECORDS	(0x01B)				// number of records dstored on device
-#define L_CURRENT	(0x01E)				// memory address of current record
-#define	L_DATETIME	(0x02B)				// address of device date & time
+#include "timeline.h"
 
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -120,9 +110,16 @@ struct HEADERFIELD fields[] = {
 
 };
 
+// fields[] has to match the snapshot's value table
+typedef char fieldcountcheck[(sizeof(fields) / sizeof(struct HEADERFIELD) == HeaderFields) ? 1 : -1];
+
 // special location for storing date to use other than the system date
 char * usedate = NULL;
 
+// the header as last read by refreshHeader()
+static struct headerSnapshot snapshot;
+static int snapshotloaded = false;
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -147,10 +144,10 @@ unsigned long getUnsignedLong(char* ptr) {
     return val;
 }
 
-static char * strDate(char * ptrDate) {
-    static char stringDate[17];
+static char * strDate(char * stringDate, const char * ptrDate) {
+    const unsigned char * bcd = (const unsigned char *) ptrDate;
 
-    sprintf(stringDate, "20%02x-%02x-%02x %02x:%02x", ptrDate[0], ptrDate[1], ptrDate[2], ptrDate[3], ptrDate[4]);
+    sprintf(stringDate, "20%02x-%02x-%02x %02x:%02x", bcd[0], bcd[1], bcd[2], bcd[3], bcd[4]);
     return stringDate;
 }
 
@@ -171,89 +168,118 @@ static char * strTime(char * ptrTime) {
 //
 
 
-void* getFieldValue(int location, int type) {
-    char buffer[8];
-    long retval = 0;
+//! Decode the field at location in the raw header. DATE fields are formatted into
+//! datestr, which is what is returned for them.
+//
+static long decodeField(char* raw, int location, int type, char* datestr) {
+    char * ptr = raw + location;
+
     switch(type) {
 
         case INT:
-            dread(buffer, location, 2);
-            retval = (long) getSignedInt(buffer);
-            break;
+            return (long) getSignedInt(ptr);
 
         case UINT:
-            dread(buffer, location, 2);
-            retval = (long) getUnsignedInt(buffer);
-            break;
+            return (long) getUnsignedInt(ptr);
 
         case ULINT:
-            dread(buffer, location, 3);
-            retval = getUnsignedLong(buffer);
-            break;
+            return getUnsignedLong(ptr);
 
         case DATE:
-            dread(buffer, location, 5);
-            //printf("DEBUG: getFieldValue DATE[%04x] - %d %d %d %d %d\n", location, buffer[0], buffer[1], buffer[2], buffer[3], buffer[4]);
-            retval = (long) strDate(buffer);
-            break;
+            //printf("DEBUG: decodeField DATE[%04x] - %d %d %d %d %d\n", location, ptr[0], ptr[1], ptr[2], ptr[3], ptr[4]);
+            return (long) strDate(datestr, ptr);
 
         case CHAR:
         default:
-            dread(buffer, location, 1);
-            retval = (long) buffer[0];
-            break;
+            return (long) ptr[0];
     }
-    return (void*) retval;
 }
 
 
-struct HEADERFIELD* getFieldData(char* fieldname) {
+//! Read the whole header (0x000 - 0x0FF) in one go and decode every field. The
+//! values are kept until the next refresh, which is only needed when the device
+//! may have moved on (e.g. when following it).
+//
+void refreshHeader() {
+    struct headerSnapshot* h = &snapshot;
+    int rows = sizeof(fields) / sizeof(struct HEADERFIELD);
+    uint64_t started = timing ? tlnow() : 0;
+
+    memset(h->raw, 0, sizeof(h->raw));
+    dread(h->raw, 0, BaseAddress);
+
+    for(int i = 0; i < rows; i++) {
+        h->value[i] = decodeField(h->raw, fields[i].location, fields[i].type, h->date[i]);
+    }
+
+    h->interval  = getUnsignedInt(h->raw + L_INTERVAL);
+    h->records   = getUnsignedInt(h->raw + L_RECORDS);
+    h->current   = getUnsignedInt(h->raw + L_CURRENT);
+    h->rpressure = getUnsignedInt(h->raw + 0x020);
+    h->apressure = getUnsignedInt(h->raw + 0x022);
+    strDate(h->datetime, h->raw + L_DATETIME);
+
+    snapshotloaded = true;
+    tlspan("header", "header", started, NULL, 0);
+}
+
+
+//! The header snapshot, read on first use.
+//
+const struct headerSnapshot* getHeader() {
+    if (!snapshotloaded) {
+        refreshHeader();
+    }
+    return &snapshot;
+}
+
+
+void* getFieldValue(int location, int type) {
+    static char datestr[17];
+
+    getHeader();
+    return (void*) decodeField(snapshot.raw, location, type, datestr);
+}
+
+
+static int getFieldIndex(char* fieldname) {
     int rows = sizeof(fields) / sizeof(struct HEADERFIELD);
     for(int i = 0; i < rows; i++) {
         if (strcmp(fields[i].name, fieldname) == 0) {
-            return &fields[i];
+            return i;
         }
     }
-    return NULL;
+    return -1;
 }
 
 
 void* getValueOfField(char* fieldname) {
-    struct HEADERFIELD* data = getFieldData(fieldname);
-    if (data != NULL) {
-        return getFieldValue(data->location, data->type);
+    int i = getFieldIndex(fieldname);
+    if (i >= 0) {
+        return (void*) getHeader()->value[i];
     }
     return (void*) -1;
 }
 
 
 unsigned int getLocationOfCurrent() {
-    char buffer[2];
-
-    dread(buffer, L_CURRENT, 2);
-    return getUnsignedInt(buffer);
+    return getHeader()->current;
 }
 
 
 unsigned int getRecordsStored() {
-    char buffer[2];
-
-    dread(buffer, L_RECORDS, 2);
-    return getUnsignedInt(buffer);
+    return getHeader()->records;
 }
 
 
 unsigned int getInterval() {
-    char buffer[2];
-
-    dread(buffer, L_INTERVAL, 2);
-    return getUnsignedInt(buffer);
+    return getHeader()->interval;
 }
 
 
 const char* getDateTime() {
     if (usedate == NULL)
-	return (char*) ((long) getValueOfField("datetime"));
+	return getHeader()->datetime;
     else
         return usedate;
 }
@@ -270,6 +296,6 @@ void listHeader() {
     //int rows = 6;
     for(int i = 0; i < rows; i++) {
         //printf("DEBUG: header field[%d].name = %s, location = %04x, type = %d\n", i, fields[i].name, fields[i].location, fields[i].type);
-        printf(fields[i].description, getFieldValue(fields[i].location, fields[i].type));
+        printf(fields[i].description, (void*) getHeader()->value[i]);
     }
 }
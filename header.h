@@ -12,6 +12,30 @@
 #ifndef _HEADER_H
 #define _HEADER_H
 
+#include "config.h"
+
+#define HeaderFields    52              // entries in the header field table (header.c)
+
+// The device header (0x000 - 0x0FF) decoded in one read, see refreshHeader().
+struct headerSnapshot {
+    unsigned int    interval;
+    unsigned int    records;
+    unsigned int    current;
+    unsigned int    rpressure;
+    unsigned int    apressure;
+    char            datetime[17];
+
+    // every header field in table order, as getValueOfField() returns them
+    // (DATE fields point at their string in date[])
+    long            value[HeaderFields];
+    char            date[HeaderFields][17];
+
+    char            raw[BaseAddress];
+};
+
+void refreshHeader();
+const struct headerSnapshot* getHeader();
+
 void listHeader();
 
 unsigned int getUnsignedInt(char * ptr);
@@ -41,12 +41,26 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "config.h"
 #include "dfile.h"
 #include "header.h"
 #include "wrecord.h"
 #include "cmdline.h"
+#include "outbuf.h"
+#include "tindex.h"
+#include "utctime.h"
+#include "aggregate.h"
+#include "sqlsink.h"
+#include "arrowsink.h"
+#include "server.h"
+#include "shmring.h"
+#include "usbtrace.h"
+#include "stats.h"
+#include "timeline.h"
 
 static void dump_options();
 static void printHelp();
@@ -85,33 +99,81 @@ void printHeader() {
     listHeader();       // see header.c
 }
 
-//! Convert a string date (UTCformat) to a time_t
+#define true (1==1)
+#define false (1==0)
+
+//! Where -o can send records instead of listing them, by the prefix of its
+//! argument.
 //
-time_t cvtStr2Time_t(char* date) {
-	// for some reason these have to be static or it f's up!!
-	static const char* fmt = "%Y-%m-%d %H:%M";
-	static struct tm tmp;
-
-	// convert to tm first using library function strptime()
-	strptime(date, fmt, &tmp);
-        tmp.tm_isdst = -1;            // unsure about daylight saving!
-
-	// return time_t using library function mktime()
-	time_t t = mktime(&tmp);
-	//printf("DEBUG: date(%s) -> %d-%02d-%02d %02d:%02d -> %d\n", date, tmp.tm_year, tmp.tm_mon, tmp.tm_mday, tmp.tm_hour, tmp.tm_min, t);
-	return t;
+static const struct sink {
+    const char* prefix;
+    void        (*open)(const char* path);
+    void        (*record)(weatherRecordPtr record, time_t time);
+    void        (*flush)();
+    void        (*close)();
+} sinks[] = {
+    { "sqlite:", sqlopen,   sqlrecord,   sqlflush,   sqlclose },
+    { "arrow:",  arrowopen, arrowrecord, arrowflush, arrowclose },
+    { "shm:",    shmopen,   shmrecord,   shmflush,   shmclose },
+};
+
+static const struct sink* sink = NULL;
+
+//! Flush the -o sink, if there is one, on the timeline.
+//
+static void flushSink() {
+    if (sink != NULL) {
+        uint64_t started = timing ? tlnow() : 0;
+        sink->flush();
+        tlspan("sink flush", "output", started, NULL, 0);
+    }
 }
 
-
-//! Convert a time-t time to a string UTC representation
+//! Open the -o sink named.
 //
-void cvtTime2Str(char* string, int maxlen,  time_t* timeptr) {
-    struct tm* tmtime = localtime(timeptr);
-    strftime(string, maxlen, "%Y-%m-%d %H:%M", tmtime);
+static void openSink(const char* name) {
+    for (int i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++) {
+        size_t length = strlen(sinks[i].prefix);
+        if (strncmp(name, sinks[i].prefix, length) == 0) {
+            sink = &sinks[i];
+            sink->open(name + length);
+            return;
+        }
+    }
+    printf("Unknown output %s, expected sqlite:path, arrow:path or shm:name\n", name);
+    exit(1);
 }
 
-#define true (1==1)
-#define false (1==0)
+//! Hand on a listed record and its time: printed according to the print spec
+//! (headings first if they are still due), or written to the -o sink. -s and
+//! -I date a record an interval earlier than -r does (by when its interval
+//! began), so sinks are given saved, the time -r lists it at, and a record
+//! stored by listings of either kind has the one time.
+//
+static void emitRecord(weatherRecordPtr p, time_t time, time_t saved, struct utcDate* date, int* headings) {
+    rstats()->rows++;
+
+    if (sink != NULL) {
+        sink->record(p, saved);
+        return;
+    }
+
+    // tell getDateTime() to use our date/time (usedate is external, see header.h)
+    usedate = (char*) utcUpdate(date, time);
+
+    // print the record using functions specified in wrecord.h
+    if (options.verbose == 0) {
+        rprints(p, recordPrintSpecification, fieldseparator);
+    }
+    else {
+        rprintv(p, recordPrintSpecification, fieldseparator, *headings);
+    }
+
+    // reset getDateTime() to use device time
+    usedate = NULL;
+    // no more headings for this list
+    *headings = 0;
+}
 
 //!**JW01**
 //! Introduced to allow listRecords to determine if it needs to track the date
@@ -121,6 +183,10 @@ void cvtTime2Str(char* string, int maxlen,  time_t* timeptr) {
 //
 int daterequired() {
     char* ptr = recordPrintSpecification;
+    if (options.output == 1) {
+        // sinks store the time of every record
+        return true;
+    }
     while(*ptr != '\0') {
         if (*ptr == 'u' || *ptr == 'U')
             return true;
@@ -133,8 +199,6 @@ int daterequired() {
 //! Checks that the end is not greater than the number of records stored
 //
 void listRecords(int start, int end) {
-    struct weatherRecord record;
-
     //printf("DEBUG: -r %d:%d\n", start, end);
 
     if (end < start) {
@@ -156,59 +220,42 @@ void listRecords(int start, int end) {
     // get current date and time using getDateTime() (see header.h)
     char* devtimestr = (char*) getDateTime();
     //printf("DEBUG: device date = %s\n", devtimestr);
-    time_t devtime = cvtStr2Time_t(devtimestr);
+    time_t devtime = utcParse(devtimestr);
 
-    // prepare, get a record pointer and a record counter and temp time
+    // prepare, get a record window, a record counter and temp time
+    struct recordWindow window;
+    rwindowclear(&window);
     weatherRecordPtr p = NULL;
     int recordidx = 0;
     time_t tmptime = devtime;
 
     if (daterequired()) {
-    // read up to the starting record, adjusting time
-        while(recordidx < start) {
-            // calculate time of the first stored record using rread() (see wrecord.h)
-            p = rread(&record, recordidx++);
-            tmptime -= (record.interval * 60);
-        }
-    }
-    else {
-        recordidx = start;
+        // time of the starting record from the intervals before it (see tindex.h)
+        tmptime -= tminutes(start) * 60;
     }
+    recordidx = start;
 
     // now recordidx is pointing at the first record to be listed
     // and tmptime is holding the time of that record
 
-    // get date string storage
-    char datestr[17];
+    // get date string storage (see utctime.h)
+    struct utcDate date;
+    utcClear(&date);
 
     // see if headings are to be printed, for options see cmdline.h
     int headings = (options.verbose == 1) ? 1 : 0;
 
     // loop through the records to be listed
     while(recordidx <= end) {
-        // read the record (see wrecord.h)
-        p = rread(&record, recordidx++);
-        // convert the date to a string
-        cvtTime2Str(datestr, 17, &tmptime);
-        // tell getDateTime() to use our date/time (usedate is external, see header.h)
-        usedate = datestr;
-
-        // print the record using functions specified in wrecord.h
-        if (options.verbose == 0) {
-            rprints(&record, recordPrintSpecification, fieldseparator);
-        }
-        else {
-            rprintv(&record, recordPrintSpecification, fieldseparator, headings);
-        }
+        // read the record, and the one before if the spec needs it (see wrecord.h)
+        p = rwindow(&window, recordidx++);
+        // print it (or pass it to the -o sink)
+        emitRecord(p, tmptime, tmptime, &date, &headings);
 
         // calculate date/time of next saved record
-        tmptime -= (record.interval * 60);
-
-        // reset getDateTime() to use device time
-        usedate = NULL;
-        // no more headings for this list
-        headings = 0;
+        tmptime -= (p->interval * 60);
     }
+    rwindowend(&window);
 
     /*
     int headings = (options.verbose == 1) ? 1 : 0;
@@ -230,18 +277,24 @@ void listRecords(int start, int end) {
 //! Checks that the time specified is not later than device time
 //
 void listRecordsSince(const char* since) {
-    struct weatherRecord record;
-    char datestr[17];
+    struct recordWindow window;
+    rwindowclear(&window);
+    struct utcDate date;
+    utcClear(&date);
 
     // convert date/time given to time_t
-    time_t since_t = cvtStr2Time_t(since);
+    time_t since_t = utcParse(since);
+    if (since_t == (time_t) -1) {
+        printf("Date %s is not in the form YYYY-MM-DD HH:MM\n", since);
+        exit(1);
+    }
 
     // get current date and time - getDateTime() found in header.h
     char* devtimestr = (char*) getDateTime();
 
     //printf("DEBUG: device date = %s\n", devtimestr);
     
-    time_t devtime = cvtStr2Time_t(devtimestr);
+    time_t devtime = utcParse(devtimestr);
 
     // check for since date in the future
     if (since_t > devtime) {
@@ -258,68 +311,232 @@ void listRecordsSince(const char* since) {
 
     // Record 0 is the current reading, it is continually overwritten until the
     // polling period is reached, at which time a new current record is started
-    // with a 0 second delay.
-    int recordidx = 0;
+    // with a 0 second delay. It is skipped, being read using -r 0.
+    //
+    // Record i is taken to be saved at the device time less the intervals of
+    // records 0..i, so it is later than since while those add up to less than
+    // the minutes back to since. The index (see tindex.h) finds the first
+    // record that isn't.
+    long minutes = (devtime - since_t + 59) / 60;
+    int last = tsearch(minutes) - 2;
+    if (last > guard - 1) {
+        last = guard - 1;
+    }
 
-    // skip the 0 record as it is the current value and should be read using
-    // -r 0
-    // (rread() found in wrecord.h)
-    weatherRecordPtr p = rread(&record, recordidx++);
+    // output the saved records from the first (recordidx == 1) to the last
+    // later than since
+    for (int recordidx = 1; recordidx <= last; recordidx++) {
+        // read the record (rwindow() found in wrecord.h)
+        weatherRecordPtr p = rwindow(&window, recordidx);
+        // calculate its date/time
+        time_t tmptime = devtime - tminutes(recordidx + 1) * 60;
+        emitRecord(p, tmptime, tmptime + p->interval * 60, &date, &headings);
+    }
+    rwindowend(&window);
+}
 
-    // calculate time of the first saved record
-    time_t tmptime = devtime - (record.interval * 60);
+//! Read the address and time of the last record exported by -I from the state
+//! file. Returns false if there isn't one (yet).
+//
+static int readSyncState(const char* statefile, unsigned int* address, time_t* saved) {
+    char datestr[17];
+    FILE* state = fopen(statefile, "r");
 
-    // starting with the first saved record (recordidx == 1)
-    // while the record time is greater than the time since (and there are records!)
-    // output the result
-    while((tmptime > since_t) && (recordidx < guard)) {
-        // read the record
-        p = rread(&record, recordidx++);
-        // calculate its date/time
-        tmptime -= (record.interval * 60);
-        // if it is later than since then print it
-        if (tmptime > since_t) {
-            cvtTime2Str(datestr, 17, &tmptime);
-            // tell getDateTime() to use our date/time (usedate is external, see header.h)
-            usedate = datestr;
-            if (options.verbose == 0) {
-                rprints(&record, recordPrintSpecification, fieldseparator);
-            }
-            else {
-                rprintv(&record, recordPrintSpecification, fieldseparator, headings);
-            }
-            // reset getDateTime() to use device time
-            usedate = NULL;
-            // no more headings for this list
-            headings = 0;
-        }
+    if (state == NULL) {
+        return false;
+    }
+    int fields = fscanf(state, "%x %16[^\n]", address, datestr);
+    fclose(state);
+
+    if (fields != 2 || *address < BaseAddress || *address >= DeviceMemorySize) {
+        return false;
     }
+    *saved = utcParse(datestr);
+    return true;
 }
 
-//! Converts a tm structured time to a seconds since type time.
+//! Record the address and time of the last record exported by -I. The file is
+//! replaced in one go so a run that is interrupted leaves the old state behind.
 //
-void cvtTime_t2Tm(struct tm* tm, const time_t* tv) {
-    /* convert it to a struct tm */
-    struct tm* rettm;
-    rettm = localtime_r(tv, tm);
-    if(rettm == NULL) {
-        printf("Bad return value from localtime_r\n");
+static void writeSyncState(const char* statefile, unsigned int address, time_t saved) {
+    char datestr[17];
+    char tmpname[strlen(statefile) + 5];
+
+    utcFormat(datestr, saved);
+    sprintf(tmpname, "%s.tmp", statefile);
+
+    FILE* state = fopen(tmpname, "w");
+    if (state == NULL) {
+        printf("Error: could not write state file %s\n", tmpname);
+        exit(1);
+    }
+    fprintf(state, "%04x %s\n", address, datestr);
+    fclose(state);
+
+    if (rename(tmpname, statefile) != 0) {
+        printf("Error: could not replace state file %s\n", statefile);
         exit(1);
     }
 }
 
-#if 0 // debug code
-void print_t(time_t* t) {
-    char buffer[32];
-    struct tm tm1;
+//! List the records SAVED since the last time this was run with the same state
+//! file (-I). The state holds the address and time of the newest record exported,
+//! so how far that record has moved back from the current one says how many new
+//! records there are: only those are read. Records are dated as listRecordsSince()
+//! dates them.
+//!
+//! With no state file, records since the -s date are listed (all saved records
+//! if there isn't one).
+//
+void listRecordsIncremental(const char* statefile) {
+    struct weatherRecord record;
+    struct recordWindow window;
+    rwindowclear(&window);
+    struct utcDate date;
+    utcClear(&date);
+
+    unsigned int lastaddress = 0;
+    time_t lasttime = 0;
+    int havestate = readSyncState(statefile, &lastaddress, &lasttime);
+
+    if (!havestate && options.printRecordsSince == 1) {
+        lasttime = utcParse(dateSince);
+    }
 
-    cvtTime_t2Tm(&tm1, t);
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M", &tm1);
-    printf("time_t = %s\n", buffer);
+    char* devtimestr = (char*) getDateTime();
+    time_t devtime = utcParse(devtimestr);
 
+    // maximum number of records, getRecordsStored() in header.h
+    int guard = getRecordsStored();
+
+    // the index the last exported record has now, from its distance back round
+    // the ring from the current record
+    int lastindex = -1;
+    if (havestate) {
+        int distance = getLocationOfCurrent() - lastaddress;
+        if (distance < 0) {
+            distance += DeviceMemorySize - BaseAddress;
+        }
+        lastindex = distance / RecordSize;
+    }
+
+    int headings = (options.verbose == 1) ? 1 : 0;
+
+    // skip the 0 record as it is the current value (see listRecordsSince())
+    int recordidx = 0;
+    rread(&record, recordidx++);
+    time_t tmptime = devtime - (record.interval * 60);
+
+    unsigned int newestaddress = 0;
+    time_t newesttime = 0;
+
+    while(recordidx < guard) {
+        weatherRecordPtr p = rwindow(&window, recordidx);
+        tmptime -= (p->interval * 60);
+
+        // caught up with the last record exported, if its time agrees (if it
+        // doesn't the ring has gone all the way round since, so carry on by date)
+        if (recordidx == lastindex && labs(tmptime - lasttime) <= 60) {
+            break;
+        }
+        if ((havestate || options.printRecordsSince == 1) && tmptime <= lasttime) {
+            break;
+        }
+
+        if (newestaddress == 0) {
+            newestaddress = p->memPos;
+            newesttime = tmptime;
+        }
+
+        emitRecord(p, tmptime, tmptime + p->interval * 60, &date, &headings);
+
+        recordidx++;
+    }
+    rwindowend(&window);
+
+    // remember the newest record for next time
+    if (newestaddress != 0) {
+        fflush(stdout);
+        writeSyncState(statefile, newestaddress, newesttime);
+    }
+}
+
+// cleared by SIGINT/SIGTERM to end --follow
+static volatile sig_atomic_t following = 1;
+
+static void stopFollowing(int sig) {
+    following = 0;
+}
+
+//! Keep the device open and list each record as it is saved, oldest first and
+//! dated as listRecords() dates them (so they follow on from a -r listing),
+//! until interrupted. Every followSeconds only the header block holding the
+//! current record pointer is read (see dpoll()); when it has moved the date &
+//! time and the records saved since are read, and nothing else. The first poll
+//! compares with the header the listing used (see dbaseline()).
+//
+void followRecords() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopFollowing;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    struct utcDate date;
+    utcClear(&date);
+    int headings = (options.verbose == 1 && options.printRecords == 0) ? 1 : 0;
+
+    // poll from the header the listing was made with, so anything saved since
+    // it is listed (a fresh poll here would skip what was saved in between)
+    const struct headerSnapshot* header = getHeader();
+    dbaseline(header->current, header->records, header->raw + L_DATETIME);
+
+    while (following) {
+        // cut short by a signal, when following is cleared
+        sleep(followSeconds);
+        if (!following) {
+            break;
+        }
+
+        uint64_t started = timing ? tlnow() : 0;
+        int saved = dpoll();
+        if (saved == 0) {
+            continue;
+        }
+        refreshHeader();
+        if (saved < 0) {
+            // cleared or reset, pick up from the new current record
+            continue;
+        }
+
+        // record 0 is still being written, records 1..saved are new
+        int records = getRecordsStored();
+        if (saved >= records) {
+            saved = records - 1;
+        }
+        time_t devtime = utcParse(getDateTime());
+
+        struct recordWindow window;
+        rwindowclear(&window);
+        for (int i = saved; i >= 1; i--) {
+            weatherRecordPtr p = rwindow(&window, i);
+            time_t savedAt = devtime - tminutes(i) * 60;
+            emitRecord(p, savedAt, savedAt, &date, &headings);
+        }
+        rwindowend(&window);
+
+        // get them out now rather than when a buffer fills
+        oflush();
+        flushSink();
+        tlspan("follow", "records", started, "records", saved);
+    }
 }
-#endif
 
+//! Print the --stats counts, however the run ends.
+//
+static void reportStats() {
+    statsreport(statsFormat);
+}
 
 //! Set up device and execute command(s).
 //
@@ -338,6 +555,43 @@ int main(int argc, char** argv) {
         exit(0);
     }
 
+    // say what the run did when it ends, see stats.h
+    if (options.stats == 1) {
+        statsstart();
+        atexit(reportStats);
+    }
+
+    // compile the print specification once for all the records listed, see wrecord.h
+    if (!rcompile(recordPrintSpecification, fieldseparator)) {
+        exit(1);
+    }
+
+    // a file doesn't get any new records (a server, simulator or replay does)
+    if (options.follow == 1 && options.inputFromFile == 1 && cmdFilename[0] != ':') {
+        printf("--follow needs the device, not a file (-F)\n");
+        exit(1);
+    }
+
+    // open the -o sink before the device, so a bad one fails early
+    if (options.output == 1) {
+        openSink(outputName);
+    }
+
+    // record where the time goes if asked to, see timeline.h
+    if (options.timeline == 1) {
+        tlopen(timelineName);
+    }
+
+    // record the usb transactions if asked to, see usbtrace.h
+    if (options.usbTrace == 1) {
+        traceopen(usbTraceName);
+    }
+
+    // keep the device (or simulator) cache between runs if asked to
+    if (options.cacheFile == 1) {
+        dcache(cacheFilename);
+    }
+
     // open the device or its imposter (file), see dfile.h
     if (options.inputFromFile == 1) {
         dopen(cmdFilename);
@@ -352,7 +606,12 @@ int main(int argc, char** argv) {
     }
 
     // now dispatch for processing
-    if (options.dumpMemory == 1) {
+    uint64_t started = timing ? tlnow() : 0;
+    if (options.serve == 1) {
+        // share the device with other wsrdrs through a socket
+        serve(socketName);
+    }
+    else if (options.dumpMemory == 1) {
         // hexdump device memory
         dumpmemory(memoryDumpStart, memoryDumpEnd, DumpWidth);
     }
@@ -360,6 +619,23 @@ int main(int argc, char** argv) {
         // copy device memory to a file
         copymem(cmdFilename);
     }
+    else if (options.aggregate == 1) {
+        // summarise the records (all of them unless -r says which)
+        if (options.printRecords == 0 || options.untilFirstRecord == 1) {
+            if (options.printRecords == 0) {
+                startRecordNumber = 0;
+            }
+            endRecordNumber = getRecordsStored();
+        }
+        else if (endRecordNumber < startRecordNumber) {
+            endRecordNumber = startRecordNumber;
+        }
+        aggregateRecords(startRecordNumber, endRecordNumber, aggregatePeriod);
+    }
+    else if (options.incremental == 1) {
+        // list records saved since the last run with this state file
+        listRecordsIncremental(stateFilename);
+    }
     else if (options.printRecordsSince == 1) {
         // list records since given date & time
         listRecordsSince(dateSince);
@@ -371,8 +647,26 @@ int main(int argc, char** argv) {
         }
         listRecords(startRecordNumber, endRecordNumber);
     }
+    tlspan("command", "records", started, "rows", rstats()->rows);
+
+    // then carry on listing records as they are saved
+    if (options.follow == 1) {
+        oflush();
+        flushSink();
+        followRecords();
+    }
+
+    // record rows are buffered, see outbuf.h
+    oflush();
+    if (sink != NULL) {
+        uint64_t closing = timing ? tlnow() : 0;
+        sink->close();
+        tlspan("sink close", "output", closing, NULL, 0);
+    }
 
     dclose();
+    traceclose();
+    tlclose();
 }
 
 
@@ -386,12 +680,30 @@ static void printHelp() {
     printf(" -h             help information\n");
     printf(" -H             list header fields\n");
     printf(" -F filename    read data from the specified file as if it were the device\n");
+    printf("                (:sim:image[,latency=us,jitter=us,interval=s,short=pct,realtime=1]\n");
+    printf("                simulates a station from the image, see simdev.c, and\n");
+    printf("                :replay:trace[,speed=n] plays back a -T trace as the device)\n");
+    printf(" -T filename    record the usb transactions of the run to a trace file\n");
+    printf(" --trace file   write a timeline of the run to file, in Chrome's trace event\n");
+    printf("                format (chrome://tracing, Perfetto)\n");
+    printf(" --stats[=json] on exit print the usb transfers, cache hits, reads and records\n");
+    printf("                of the run on stderr, as text or one line of json\n");
     printf(" -w filename    write device memory to the specified file\n");
+    printf(" -C filename    keep the device cache in the specified file between runs\n");
+    printf(" -D socket      serve the device to other wsrdrs on a unix socket, which they\n");
+    printf("                read with -F :sock:socket\n");
     printf(" -v             verbose, causes headings to be listed\n");
     printf(" -m start:end   dump device memory from start to end (specified in hex)\n");
     printf(" -r start:end   hex dump of records (0 = current, 1 = last saved, etc)\n");
     printf("\nsub-options of -r\n");
     printf("\t-s \"date\"  list records (r > 0) saved since the specified utc formatted date\n");
+    printf("\t-I file    list records saved since the last run using the same state file\n");
+    printf("\t-A period  summarise the records by hour, day or week (min/max/mean, rain)\n");
+    printf("\t-o sqlite:file  store the records in an sqlite3 database instead of listing them\n");
+    printf("\t-o arrow:file   write the records to an Arrow IPC (feather) file instead\n");
+    printf("\t-o shm:name     publish the records in a shared memory ring (/dev/shm/name)\n");
+    printf("\t--follow[=secs] then list records as they are saved, checking every secs\n");
+    printf("\t\t(default %d) until interrupted\n", FollowSeconds);
     printf("\t-S \"string\" use the specified string as a separator between fields\n");
     printf("\t-p \"spec\"  Print using the specification string, see below\n");
     printf("\t\ta.... the device memory address (in hex)\n");
@@ -406,6 +718,10 @@ static void printHelp() {
     printf("\t\tg.... gust speed\n");
     printf("\t\td.... wind direction\n");
     printf("\t\ti.... record interval (time since previous save in mins)\n");
+    printf("\t\te.... record error code\n");
+    printf("\t\ty.... rain meter difference as a rate per hour\n");
+    printf("\t\tP.... pressure change from previous\n");
+    printf("\t\tc.... temperature outside change from previous\n");
     printf("\t\tu.... date/time of the data as utc\n");
     printf("\t\tU.... as u but with the value enclosed in ''s\n");
     printf("\n\nfor example:\n");
@@ -424,6 +740,15 @@ static void dump_options() {
     printf("options.writeMemoryToFile    = %d\n", options.writeMemoryToFile);
     printf("options.showHelp             = %d\n", options.showHelp);
     printf("options.verbose              = %d\n", options.verbose);
+    printf("options.cacheFile            = %d\n", options.cacheFile);
+    printf("options.incremental          = %d\n", options.incremental);
+    printf("options.aggregate            = %d\n", options.aggregate);
+    printf("options.output               = %d\n", options.output);
+    printf("options.follow               = %d\n", options.follow);
+    printf("options.serve                = %d\n", options.serve);
+    printf("options.usbTrace             = %d\n", options.usbTrace);
+    printf("options.stats                = %d\n", options.stats);
+    printf("options.timeline             = %d\n", options.timeline);
 
     printf("\nmemory dump %04x:%04x\n", memoryDumpStart, memoryDumpEnd);
     printf("record print range %d:%d\n", startRecordNumber, endRecordNumber);
@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# check.sh - run wsrdr's usb path against the mock device (see mockusb.c)
+#
+#   mock/check.sh [wsrdr-mock] [wsrdr-bench] [wsrdr] [wsrdr-nosimd] [simdcheck]
+#
+# The synthetic full ring of the benchmarks is served by the mock. Listings read
+# through usb (with transfers in flight, timing out and being retried) have to
+# match listings of the image file, a copy of memory has to match the image, and
+# SIGTERM during a read has to close the device before wsrdr exits. The same
+# image summarised by wsrdr and by wsrdr built with -DNO_SIMD has to come out
+# the same, as do the columns of simdcheck.c. Run by make check.
+
+wsrdr=${1:-./mock/wsrdr-mock}
+bench=${2:-./bench/wsrdr-bench}
+plain=${3:-./wsrdr}
+nosimd=${4:-./mock/wsrdr-nosimd}
+simdcheck=${5:-./mock/simdcheck}
+spec=uaHhTtrRpwgd
+
+work=$(mktemp -d /tmp/wsrdr-check-XXXXXX) || exit 1
+trap 'rm -rf "$work"' EXIT
+failed=0
+
+pass() {
+    echo "ok    $1"
+}
+
+fail() {
+    echo "FAIL  $1"
+    failed=1
+}
+
+"$bench" -w "$work/image.bin" || exit 1
+"$wsrdr" -r 0:4000 -p $spec -F "$work/image.bin" > "$work/file.txt" 2>&1
+
+# listings through usb, as they come and with every 7th reply timing out
+MOCK_IMAGE="$work/image.bin" "$wsrdr" -r 0:4000 -p $spec > "$work/usb.txt" 2>&1
+if cmp -s "$work/file.txt" "$work/usb.txt"; then pass "listing"; else fail "listing"; fi
+
+MOCK_IMAGE="$work/image.bin" MOCK_TIMEOUT=7 "$wsrdr" -r 0:4000 -p $spec > "$work/retry.txt" 2>&1
+if cmp -s "$work/file.txt" "$work/retry.txt"; then pass "listing with timeouts"; else fail "listing with timeouts"; fi
+
+# a copy of memory up to the current record
+MOCK_IMAGE="$work/image.bin" "$wsrdr" -w "$work/copy.bin" > /dev/null 2>&1
+size=$(wc -c < "$work/copy.bin")
+if [ "$size" -gt 256 ] && cmp -s -n "$size" "$work/image.bin" "$work/copy.bin"; then
+    pass "copy"
+else
+    fail "copy"
+fi
+
+# SIGTERM part way through a slow listing
+MOCK_IMAGE="$work/image.bin" MOCK_LATENCY_US=2000 MOCK_REPORT=1 \
+    "$wsrdr" -r 0:4000 -p $spec > "$work/term.txt" 2> "$work/term.err" &
+pid=$!
+sleep 1
+kill -TERM $pid
+wait $pid
+status=$?
+if [ $status -ne 0 ] && grep -q "closed=1 exited=1" "$work/term.err"; then
+    pass "SIGTERM"
+else
+    fail "SIGTERM (exit $status: $(cat "$work/term.err"))"
+fi
+
+# the SSSE3 record decoding against the plain loop
+for period in hour day week; do
+    "$plain" -A $period -F "$work/image.bin" > "$work/simd.txt" 2>&1
+    "$nosimd" -A $period -F "$work/image.bin" > "$work/nosimd.txt" 2>&1
+    if [ -s "$work/simd.txt" ] && cmp -s "$work/simd.txt" "$work/nosimd.txt"; then
+        pass "summary by $period without SIMD"
+    else
+        fail "summary by $period without SIMD"
+    fi
+done
+
+if "$simdcheck" > "$work/simdcheck.txt" 2>&1; then
+    pass "SSSE3 columns"
+else
+    fail "SSSE3 columns ($(cat "$work/simdcheck.txt"))"
+fi
+
+exit $failed
@@ -0,0 +1,176 @@
+/*
+ *! libusb.h
+ *!
+ *! The part of the libusb-1.0 interface usbdrv.c uses, for building wsrdr
+ *! against the mock device in mockusb.c instead of the library (make check).
+ *! Only what usbdrv.c needs is declared, with the values libusb gives them.
+ *!
+ *! V0.1
+ */
+
+#ifndef _MOCK_LIBUSB_H
+#define _MOCK_LIBUSB_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIBUSB_CALL
+#define LIBUSB_CONTROL_SETUP_SIZE   8
+
+enum libusb_error {
+    LIBUSB_SUCCESS          = 0,
+    LIBUSB_ERROR_IO         = -1,
+    LIBUSB_ERROR_NOT_FOUND  = -5,
+    LIBUSB_ERROR_TIMEOUT    = -7
+};
+
+enum libusb_request_type {
+    LIBUSB_REQUEST_TYPE_STANDARD    = 0x00 << 5,
+    LIBUSB_REQUEST_TYPE_CLASS       = 0x01 << 5
+};
+
+enum libusb_request_recipient {
+    LIBUSB_RECIPIENT_DEVICE     = 0x00,
+    LIBUSB_RECIPIENT_INTERFACE  = 0x01
+};
+
+enum libusb_endpoint_direction {
+    LIBUSB_ENDPOINT_OUT = 0x00,
+    LIBUSB_ENDPOINT_IN  = 0x80
+};
+
+enum libusb_transfer_type {
+    LIBUSB_TRANSFER_TYPE_CONTROL    = 0,
+    LIBUSB_TRANSFER_TYPE_INTERRUPT  = 3
+};
+
+enum libusb_transfer_status {
+    LIBUSB_TRANSFER_COMPLETED,
+    LIBUSB_TRANSFER_ERROR,
+    LIBUSB_TRANSFER_TIMED_OUT,
+    LIBUSB_TRANSFER_CANCELLED,
+    LIBUSB_TRANSFER_STALL,
+    LIBUSB_TRANSFER_NO_DEVICE,
+    LIBUSB_TRANSFER_OVERFLOW
+};
+
+#define LIBUSB_REQUEST_GET_DESCRIPTOR   0x06
+
+typedef struct libusb_context libusb_context;
+typedef struct libusb_device libusb_device;
+typedef struct libusb_device_handle libusb_device_handle;
+
+struct libusb_device_descriptor {
+    uint8_t     bLength;
+    uint8_t     bDescriptorType;
+    uint16_t    bcdUSB;
+    uint8_t     bDeviceClass;
+    uint8_t     bDeviceSubClass;
+    uint8_t     bDeviceProtocol;
+    uint8_t     bMaxPacketSize0;
+    uint16_t    idVendor;
+    uint16_t    idProduct;
+};
+
+struct libusb_transfer;
+typedef void (LIBUSB_CALL *libusb_transfer_cb_fn)(struct libusb_transfer* transfer);
+
+struct libusb_transfer {
+    libusb_device_handle*       dev_handle;
+    uint8_t                     flags;
+    unsigned char               endpoint;
+    unsigned char               type;
+    unsigned int                timeout;
+    enum libusb_transfer_status status;
+    int                         length;
+    int                         actual_length;
+    libusb_transfer_cb_fn       callback;
+    void*                       user_data;
+    unsigned char*              buffer;
+    int                         num_iso_packets;
+};
+
+int libusb_init(libusb_context** ctx);
+void libusb_exit(libusb_context* ctx);
+
+ssize_t libusb_get_device_list(libusb_context* ctx, libusb_device*** list);
+void libusb_free_device_list(libusb_device** list, int unref_devices);
+libusb_device* libusb_ref_device(libusb_device* dev);
+void libusb_unref_device(libusb_device* dev);
+int libusb_get_device_descriptor(libusb_device* dev, struct libusb_device_descriptor* desc);
+
+int libusb_open(libusb_device* dev, libusb_device_handle** dev_handle);
+void libusb_close(libusb_device_handle* dev_handle);
+int libusb_kernel_driver_active(libusb_device_handle* dev_handle, int interface_number);
+int libusb_detach_kernel_driver(libusb_device_handle* dev_handle, int interface_number);
+int libusb_claim_interface(libusb_device_handle* dev_handle, int interface_number);
+int libusb_release_interface(libusb_device_handle* dev_handle, int interface_number);
+int libusb_set_configuration(libusb_device_handle* dev_handle, int configuration);
+int libusb_set_interface_alt_setting(libusb_device_handle* dev_handle, int interface_number, int alternate_setting);
+
+int libusb_control_transfer(libusb_device_handle* dev_handle, uint8_t request_type, uint8_t bRequest,
+                            uint16_t wValue, uint16_t wIndex, unsigned char* data, uint16_t wLength,
+                            unsigned int timeout);
+int libusb_interrupt_transfer(libusb_device_handle* dev_handle, unsigned char endpoint, unsigned char* data,
+                              int length, int* actual_length, unsigned int timeout);
+
+struct libusb_transfer* libusb_alloc_transfer(int iso_packets);
+void libusb_free_transfer(struct libusb_transfer* transfer);
+int libusb_submit_transfer(struct libusb_transfer* transfer);
+int libusb_handle_events_timeout_completed(libusb_context* ctx, struct timeval* tv, int* completed);
+
+static inline int libusb_get_descriptor(libusb_device_handle* dev_handle, uint8_t desc_type, uint8_t desc_index,
+                                        unsigned char* data, int length) {
+    return libusb_control_transfer(dev_handle, LIBUSB_ENDPOINT_IN, LIBUSB_REQUEST_GET_DESCRIPTOR,
+                                   (uint16_t) ((desc_type << 8) | desc_index), 0, data, (uint16_t) length, 1000);
+}
+
+static inline void libusb_fill_control_setup(unsigned char* buffer, uint8_t bmRequestType, uint8_t bRequest,
+                                             uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+    buffer[0] = bmRequestType;
+    buffer[1] = bRequest;
+    buffer[2] = wValue & 0xFF;
+    buffer[3] = wValue >> 8;
+    buffer[4] = wIndex & 0xFF;
+    buffer[5] = wIndex >> 8;
+    buffer[6] = wLength & 0xFF;
+    buffer[7] = wLength >> 8;
+}
+
+static inline void libusb_fill_control_transfer(struct libusb_transfer* transfer, libusb_device_handle* dev_handle,
+                                                unsigned char* buffer, libusb_transfer_cb_fn callback,
+                                                void* user_data, unsigned int timeout) {
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = 0;
+    transfer->type = LIBUSB_TRANSFER_TYPE_CONTROL;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    transfer->length = LIBUSB_CONTROL_SETUP_SIZE + (buffer[6] | (buffer[7] << 8));
+    transfer->user_data = user_data;
+    transfer->callback = callback;
+}
+
+static inline void libusb_fill_interrupt_transfer(struct libusb_transfer* transfer, libusb_device_handle* dev_handle,
+                                                  unsigned char endpoint, unsigned char* buffer, int length,
+                                                  libusb_transfer_cb_fn callback, void* user_data,
+                                                  unsigned int timeout) {
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = endpoint;
+    transfer->type = LIBUSB_TRANSFER_TYPE_INTERRUPT;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    transfer->length = length;
+    transfer->user_data = user_data;
+    transfer->callback = callback;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MOCK_LIBUSB_H */
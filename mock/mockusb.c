@@ -0,0 +1,307 @@
+/*
+ *! mockusb.c
+ *!
+ *! A WH1081 behind the libusb-1.0 calls usbdrv.c makes, so the asynchronous
+ *! transfer path can be run and checked without a station (make check). The
+ *! station's memory comes from the image file named by MOCK_IMAGE.
+ *!
+ *! Like the station, it answers one thing at a time: submitted transfers are
+ *! completed in order by libusb_handle_events_timeout_completed(), read
+ *! commands (on ep0) queue their locations and each interrupt read takes the
+ *! reply to the oldest one. So with several reads in flight the replies still
+ *! have to come back to the right blocks.
+ *!
+ *!     MOCK_IMAGE=file     the station's memory
+ *!     MOCK_LATENCY_US=us  time each transfer takes (default 0)
+ *!     MOCK_TIMEOUT=n      every nth interrupt read times out, losing its reply
+ *!     MOCK_REPORT=1       print the counts at exit, and whether the device was
+ *!                         closed and libusb_exit() called
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "libusb.h"
+
+#define MockMemory      0x10000
+#define MockQueue       64              // transfers (and read commands) outstanding at once
+#define MockReadCommand 9               // the class request carrying the 8 byte read command
+
+struct libusb_context { int unused; };
+struct libusb_device { int unused; };
+struct libusb_device_handle { int unused; };
+
+static struct libusb_context context;
+static struct libusb_device device;
+static struct libusb_device_handle handle;
+
+static unsigned char memory[MockMemory];
+static long latency = 0;
+static long timeoutEvery = 0;
+
+// submitted transfers, completed in order
+static struct libusb_transfer* queue[MockQueue];
+static int queued = 0;
+
+// locations of read commands not yet replied to, oldest first
+static long commands[MockQueue];
+static int commandHead = 0;
+static int commandTail = 0;
+
+static int closed = 0;
+static int exited = 0;
+
+static struct {
+    long commands;
+    long replies;
+    long timeouts;
+    long deepest;                       // most transfers queued at once
+} counts;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t arrived = PTHREAD_COND_INITIALIZER;
+
+
+static long environment(const char* name, long otherwise) {
+    const char* value = getenv(name);
+    return (value != NULL) ? atol(value) : otherwise;
+}
+
+static void report() {
+    fprintf(stderr, "mock: commands=%ld replies=%ld timeouts=%ld deepest=%ld closed=%d exited=%d\n",
+            counts.commands, counts.replies, counts.timeouts, counts.deepest, closed, exited);
+}
+
+//! The location an 8 byte read command asks for (0xa1, address high, low, size).
+//
+static long commandLocation(const unsigned char* command) {
+    return (command[1] << 8) | command[2];
+}
+
+//! The reply to the oldest read command outstanding, or a timed out read.
+//
+static int reply(unsigned char* data, int length) {
+    counts.replies++;
+    if (commandHead == commandTail) {
+        return LIBUSB_ERROR_IO;         // nothing was asked for
+    }
+    long location = commands[commandHead++ % MockQueue];
+
+    if (timeoutEvery > 0 && counts.replies % timeoutEvery == 0) {
+        counts.timeouts++;
+        return LIBUSB_ERROR_TIMEOUT;
+    }
+    if (location + length > MockMemory) {
+        length = MockMemory - location;
+    }
+    memcpy(data, memory + location, length);
+    return length;
+}
+
+int libusb_init(libusb_context** ctx) {
+    const char* path = getenv("MOCK_IMAGE");
+    FILE* f = (path != NULL) ? fopen(path, "rb") : NULL;
+    if (f == NULL) {
+        fprintf(stderr, "mock: set MOCK_IMAGE to the station image to serve\n");
+        return LIBUSB_ERROR_IO;
+    }
+    if (fread(memory, 1, sizeof(memory), f) == 0) {
+        fprintf(stderr, "mock: %s is empty\n", path);
+    }
+    fclose(f);
+
+    latency = environment("MOCK_LATENCY_US", 0);
+    timeoutEvery = environment("MOCK_TIMEOUT", 0);
+    if (environment("MOCK_REPORT", 0)) {
+        atexit(report);
+    }
+    *ctx = &context;
+    return LIBUSB_SUCCESS;
+}
+
+void libusb_exit(libusb_context* ctx) {
+    exited = 1;
+}
+
+ssize_t libusb_get_device_list(libusb_context* ctx, libusb_device*** list) {
+    static libusb_device* devices[] = { &device, NULL };
+    *list = devices;
+    return 1;
+}
+
+void libusb_free_device_list(libusb_device** list, int unref_devices) {
+}
+
+libusb_device* libusb_ref_device(libusb_device* dev) {
+    return dev;
+}
+
+void libusb_unref_device(libusb_device* dev) {
+}
+
+int libusb_get_device_descriptor(libusb_device* dev, struct libusb_device_descriptor* desc) {
+    memset(desc, 0, sizeof(*desc));
+    desc->idVendor = 0x1941;
+    desc->idProduct = 0x8021;
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_open(libusb_device* dev, libusb_device_handle** dev_handle) {
+    *dev_handle = &handle;
+    return LIBUSB_SUCCESS;
+}
+
+//! Closing the handle wakes the event thread, as libusb does.
+//
+void libusb_close(libusb_device_handle* dev_handle) {
+    pthread_mutex_lock(&lock);
+    closed = 1;
+    pthread_cond_broadcast(&arrived);
+    pthread_mutex_unlock(&lock);
+}
+
+int libusb_kernel_driver_active(libusb_device_handle* dev_handle, int interface_number) {
+    return 0;
+}
+
+int libusb_detach_kernel_driver(libusb_device_handle* dev_handle, int interface_number) {
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_claim_interface(libusb_device_handle* dev_handle, int interface_number) {
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_release_interface(libusb_device_handle* dev_handle, int interface_number) {
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_set_configuration(libusb_device_handle* dev_handle, int configuration) {
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_set_interface_alt_setting(libusb_device_handle* dev_handle, int interface_number, int alternate_setting) {
+    return LIBUSB_SUCCESS;
+}
+
+//! Descriptor reads come back zeroed; a read command is queued like a
+//! submitted one.
+//
+int libusb_control_transfer(libusb_device_handle* dev_handle, uint8_t request_type, uint8_t bRequest,
+                            uint16_t wValue, uint16_t wIndex, unsigned char* data, uint16_t wLength,
+                            unsigned int timeout) {
+    if (request_type & LIBUSB_ENDPOINT_IN) {
+        memset(data, 0, wLength);
+    }
+    else if (bRequest == MockReadCommand && wLength == 8) {
+        pthread_mutex_lock(&lock);
+        counts.commands++;
+        commands[commandTail++ % MockQueue] = commandLocation(data);
+        pthread_mutex_unlock(&lock);
+    }
+    return wLength;
+}
+
+int libusb_interrupt_transfer(libusb_device_handle* dev_handle, unsigned char endpoint, unsigned char* data,
+                              int length, int* actual_length, unsigned int timeout) {
+    pthread_mutex_lock(&lock);
+    int ret = reply(data, length);
+    pthread_mutex_unlock(&lock);
+
+    *actual_length = (ret > 0) ? ret : 0;
+    return (ret >= 0) ? LIBUSB_SUCCESS : ret;
+}
+
+struct libusb_transfer* libusb_alloc_transfer(int iso_packets) {
+    return calloc(1, sizeof(struct libusb_transfer));
+}
+
+void libusb_free_transfer(struct libusb_transfer* transfer) {
+    free(transfer);
+}
+
+int libusb_submit_transfer(struct libusb_transfer* transfer) {
+    pthread_mutex_lock(&lock);
+    if (queued == MockQueue) {
+        pthread_mutex_unlock(&lock);
+        return LIBUSB_ERROR_IO;
+    }
+    queue[queued++] = transfer;
+    if (queued > counts.deepest) {
+        counts.deepest = queued;
+    }
+    pthread_cond_broadcast(&arrived);
+    pthread_mutex_unlock(&lock);
+    return LIBUSB_SUCCESS;
+}
+
+//! Completes the oldest transfer submitted, waiting up to tv for one.
+//
+int libusb_handle_events_timeout_completed(libusb_context* ctx, struct timeval* tv, int* completed) {
+    pthread_mutex_lock(&lock);
+    if (queued == 0 && !closed) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += tv->tv_sec;
+        until.tv_nsec += tv->tv_usec * 1000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&arrived, &lock, &until);
+    }
+    if (queued == 0) {
+        pthread_mutex_unlock(&lock);
+        return LIBUSB_SUCCESS;
+    }
+
+    struct libusb_transfer* transfer = queue[0];
+    memmove(queue, queue + 1, --queued * sizeof(queue[0]));
+
+    transfer->status = LIBUSB_TRANSFER_COMPLETED;
+    if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL) {
+        counts.commands++;
+        commands[commandTail++ % MockQueue] = commandLocation(transfer->buffer + LIBUSB_CONTROL_SETUP_SIZE);
+        transfer->actual_length = transfer->length - LIBUSB_CONTROL_SETUP_SIZE;
+    }
+    else {
+        int ret = reply(transfer->buffer, transfer->length);
+        if (ret == LIBUSB_ERROR_TIMEOUT) {
+            transfer->status = LIBUSB_TRANSFER_TIMED_OUT;
+        }
+        else if (ret < 0) {
+            transfer->status = LIBUSB_TRANSFER_ERROR;
+        }
+        transfer->actual_length = (ret > 0) ? ret : 0;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (latency > 0) {
+        usleep(latency);
+    }
+    transfer->callback(transfer);
+    return LIBUSB_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/*
+ *! simdcheck.c
+ *!
+ *! Decodes the same raw records with wbatch.c's scalar loop and its SSSE3
+ *! kernel and checks that every column comes out the same (make check). The
+ *! records are random bytes with the temperatures set to the awkward
+ *! sign-magnitude values (0x8000 is minus nought), runs are cut at every length
+ *! up to a few vectors so the leftovers are decoded too, and memory positions
+ *! run past the top of memory. wbatch.c is included so that both decoders can be
+ *! called as they are.
+ *!
+ *!     simdcheck       exit 0 when the columns match (or there's no SSSE3 kernel
+ *!                     on this build or CPU, which is said), 1 when not
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../wbatch.c"
+
+#define CheckRecords    1000
+#define CheckRuns       40              // run lengths 1..CheckRuns, then CheckRecords
+
+static const unsigned int awkward[] = {
+    0x0000, 0x0001, 0x00FF, 0x0100, 0x7FFF, 0x8000, 0x8001, 0x80FF, 0x8100, 0xFF00, 0xFFFF
+};
+
+static unsigned long seed = 1081;
+
+static unsigned long checkrandom() {
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    return seed >> 33;
+}
+
+#ifdef DecodeSSSE3
+
+#define compare(column, size)   \
+    if (memcmp(scalar.column + at, vector.column + at, n * (size)) != 0) { \
+        printf("simdcheck: %s differs decoding %d records at %d from 0x%04lx\n", #column, n, at, location); \
+        return false; \
+    }
+
+//! Decode n records both ways into columns at..at+n-1 and compare them.
+//
+static int check(struct weatherColumns* scalarCols, struct weatherColumns* vectorCols, const char* raw, int at, int n, long location) {
+    struct weatherColumns scalar = *scalarCols, vector = *vectorCols;
+
+    decodeColumnsScalar(&scalar, at, raw, n, location);
+    decodeColumnsSSSE3(&vector, at, raw, n, location);
+
+    compare(memPos, sizeof(uint16_t));
+    compare(interval, 1);
+    compare(humIn, 1);
+    compare(tempIn, sizeof(int16_t));
+    compare(humOut, 1);
+    compare(tempOut, sizeof(int16_t));
+    compare(press, sizeof(uint16_t));
+    compare(windSpeed, 1);
+    compare(gustSpeed, sizeof(uint16_t));
+    compare(windDir, 1);
+    compare(rainCounter, sizeof(uint16_t));
+    compare(errorCode, 1);
+    return true;
+}
+
+#undef compare
+
+#endif
+
+int main(int argc, char** argv) {
+#ifndef DecodeSSSE3
+    printf("simdcheck: built without the SSSE3 kernel, nothing to check\n");
+    return 0;
+#else
+    if (!__builtin_cpu_supports("ssse3")) {
+        printf("simdcheck: no SSSE3 on this CPU, nothing to check\n");
+        return 0;
+    }
+
+    static char raw[CheckRecords * RecordSize];
+    int awkwardValues = sizeof(awkward) / sizeof(awkward[0]);
+    for(int i = 0; i < CheckRecords; i++) {
+        char* r = raw + i * RecordSize;
+        for(int b = 0; b < RecordSize; b++) {
+            r[b] = checkrandom() & 0xFF;
+        }
+        unsigned int tempIn = awkward[i % awkwardValues];
+        unsigned int tempOut = awkward[(i / awkwardValues) % awkwardValues];
+        r[0x02] = tempIn & 0xFF;  r[0x03] = tempIn >> 8;
+        r[0x05] = tempOut & 0xFF; r[0x06] = tempOut >> 8;
+    }
+
+    struct weatherColumns scalar, vector;
+    if (!allocColumns(&scalar, CheckRecords + 8) || !allocColumns(&vector, CheckRecords + 8)) {
+        printf("simdcheck: out of memory\n");
+        return 1;
+    }
+
+    int ok = true;
+    for(int n = 1; n <= CheckRuns && ok; n++) {
+        for(int at = 0; at < 8 && ok; at++) {
+            ok = check(&scalar, &vector, raw + at * RecordSize, at, n, BaseAddress + at * RecordSize);
+        }
+    }
+    if (ok) {
+        ok = check(&scalar, &vector, raw, 0, CheckRecords, BaseAddress);
+    }
+    if (ok) {
+        // past the top of memory the positions wrap, as they do in 16 bits
+        ok = check(&scalar, &vector, raw, 3, 64, 0x10000 - 20 * RecordSize);
+    }
+
+    freeColumns(&scalar);
+    freeColumns(&vector);
+    return ok ? 0 : 1;
+#endif
+}
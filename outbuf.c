@@ -0,0 +1,240 @@
+/*
+ *! outbuf.c
+ *!
+ *! Output for listing records. Rows are collected in a buffer (OutputBufferSize
+ *! in config.h) that is handed to write() when it fills up, and the numbers in
+ *! them are formatted here from integers, two digits at a time from a table,
+ *! rather than by printf. Fields the device holds in tenths are formatted from
+ *! those tenths, so no doubles are involved; the text is the same as printf's.
+ *!
+ *! Anything printed with stdio is flushed before the buffer is first used, and
+ *! the buffer is flushed by oflush() and at exit, so the two don't get mixed up.
+ *! Errors that can come part way through a listing (a failed read, say) call
+ *! oflush() before printing, so they follow the rows listed before them.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "config.h"
+#include "outbuf.h"
+#include "timeline.h"
+
+static char buffer[OutputBufferSize];
+static int used = 0;
+static int registered = 0;
+static int exiting = 0;                 // flushing from atexit(), see oexit()
+
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hexDigits[] = "0123456789abcdef";
+
+
+//! Write all of the given vectors to standard output, carrying on after short
+//! writes and interrupts.
+//
+static void owritev(struct iovec* iov, int count) {
+    uint64_t started = timing ? tlnow() : 0;
+    long bytes = 0;
+    for (int i = 0; i < count; i++) {
+        bytes += iov[i].iov_len;
+    }
+
+    while (count > 0) {
+        ssize_t n = writev(STDOUT_FILENO, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // nowhere left to report to if it was stdout that went. exit()
+            // can't be called again when this is the flush at exit
+            if (exiting) {
+                _exit(1);
+            }
+            exit(1);
+        }
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    tlspan("write", "output", started, "bytes", bytes);
+}
+
+//! Write out whatever is buffered.
+//
+void oflush() {
+    if (used > 0) {
+        struct iovec iov = { buffer, used };
+        owritev(&iov, 1);
+        used = 0;
+    }
+}
+
+//! The flush at exit.
+//
+static void oexit() {
+    exiting = 1;
+    oflush();
+}
+
+//! Make room for size more bytes. Output printed through stdio before the
+//! buffer is started on goes out first.
+//
+static inline void oreserve(int size) {
+    if (used == 0) {
+        fflush(stdout);
+        if (!registered) {
+            atexit(oexit);
+            registered = 1;
+        }
+    }
+    else if (used + size > OutputBufferSize) {
+        oflush();
+    }
+}
+
+//! Append bytes to the buffer. Anything too big to fit goes straight out behind
+//! what is already buffered, in the one writev().
+//
+void owrite(const char* data, int size) {
+    if (size > OutputBufferSize - used) {
+        if (used == 0) {
+            oreserve(0);
+        }
+        struct iovec iov[2] = { { buffer, used }, { (void*) data, size } };
+        owritev(iov, 2);
+        used = 0;
+        return;
+    }
+    oreserve(size);
+    memcpy(buffer + used, data, size);
+    used += size;
+}
+
+void oputs(const char* string) {
+    owrite(string, strlen(string));
+}
+
+void oputc(char c) {
+    oreserve(1);
+    buffer[used++] = c;
+}
+
+//! Format value in decimal, backwards from end. Returns where it starts.
+//
+static char* odigits(char* end, unsigned long value) {
+    while (value >= 100) {
+        const char* pair = digitPairs + (value % 100) * 2;
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        *--end = digitPairs[value * 2 + 1];
+        *--end = digitPairs[value * 2];
+    }
+    else {
+        *--end = '0' + value;
+    }
+    return end;
+}
+
+//! Copy the formatted text from start to end into the buffer, right aligned in
+//! width with spaces the way printf pads.
+//
+static void opad(const char* start, const char* end, int width) {
+    int length = end - start;
+    int pad = (width > length) ? width - length : 0;
+
+    oreserve(pad + length);
+    memset(buffer + used, ' ', pad);
+    memcpy(buffer + used + pad, start, length);
+    used += pad + length;
+}
+
+void ofield(const char* string, int width) {
+    opad(string, string + strlen(string), width);
+}
+
+void oint(long value, int width) {
+    char text[24];
+    char* end = text + sizeof(text);
+    char* start;
+
+    if (value < 0) {
+        start = odigits(end, -(unsigned long) value);
+        *--start = '-';
+    }
+    else {
+        start = odigits(end, value);
+    }
+    opad(start, end, width);
+}
+
+void ohex(unsigned long value, int digits) {
+    char text[2 * sizeof(long)];
+    char* end = text + sizeof(text);
+    char* start = end;
+
+    do {
+        *--start = hexDigits[value & 0x0F];
+        value >>= 4;
+    } while (value != 0 && start > text);
+    while (end - start < digits && start > text) {
+        *--start = '0';
+    }
+    opad(start, end, 0);
+}
+
+void otenths(long value, int width) {
+    char text[24];
+    char* end = text + sizeof(text);
+    unsigned long magnitude = (value < 0) ? -(unsigned long) value : value;
+
+    *--end = '0' + magnitude % 10;
+    *--end = '.';
+    char* start = odigits(end, magnitude / 10);
+    if (value < 0) {
+        *--start = '-';
+    }
+    opad(start, text + sizeof(text), width);
+}
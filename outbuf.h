@@ -0,0 +1,41 @@
+/*
+ * File:   outbuf.h
+ *
+ * Buffered standard output for record rows, with integer formatting that
+ * doesn't go through printf.
+ */
+
+// V0.1
+
+#ifndef _OUTBUF_H
+#define	_OUTBUF_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // append bytes/a string/a character to the output buffer
+    void owrite(const char* data, int size);
+    void oputs(const char* string);
+    void oputc(char c);
+
+    // as printf("%*s", width, string)
+    void ofield(const char* string, int width);
+
+    // as printf("%*d", width, value), width 0 for "%d"
+    void oint(long value, int width);
+
+    // as printf("%0*x", digits, value)
+    void ohex(unsigned long value, int digits);
+
+    // a value held in tenths as printf("%*.1f", width, value / 10.0)
+    void otenths(long value, int width);
+
+    // write out whatever is buffered
+    void oflush();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _OUTBUF_H */
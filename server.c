@@ -0,0 +1,484 @@
+/*
+ *! server.c
+ *!
+ *! One wsrdr (-D path) keeps the device open, with its chstream cache, and
+ *! answers requests for memory, the header and records on a unix domain socket,
+ *! so graphing, alerting and archiving jobs share one usb session instead of
+ *! queueing on the device and each reading it again. Any wsrdr can be a client
+ *! with -F :sock:path (see dfile.c).
+ *!
+ *! The protocol is binary: an 8 byte struct serverRequest, answered with an
+ *! 8 byte struct serverReply and the data (see server.h). Clients may send any
+ *! number of requests without waiting, replies come back in order.
+ *!
+ *! A single poll() loop serves every client, so device reads are never
+ *! concurrent. Each round takes all the requests that have arrived and reads
+ *! the blocks they need that aren't cached in one batch, so a block wanted by
+ *! several clients is only read once; then they are all answered from the cache.
+ *! When a request involves the header the device is checked for new records
+ *! (dpoll(), at most once every ServerPollSeconds), which marks only the blocks
+ *! it has written to for reading again.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "header.h"
+#include "dfile.h"
+#include "outbuf.h"
+#include "server.h"
+
+#define ServerClients       32          // clients served at once
+#define ServerChunk         4096        // most bytes a client asks for in one ServerRead
+
+struct client {
+    int             fd;
+    unsigned char   in[sizeof(struct serverRequest)];
+    int             have;               // bytes of the next request in[]
+    char*           out;                // replies not yet written
+    size_t          outlength;
+    size_t          outsent;
+    size_t          outsize;
+};
+
+static struct client clients[ServerClients];
+static int nclients = 0;
+
+static volatile sig_atomic_t serving = 1;
+static time_t polled = 0;
+
+
+static void stopServing(int sig) {
+    serving = 0;
+}
+
+//! Checks the device for new records, at most once every ServerPollSeconds, and
+//! reloads the header if there are any.
+//
+static void freshen() {
+    time_t now = time(NULL);
+    if (now - polled < ServerPollSeconds) {
+        return;
+    }
+    polled = now;
+    if (dpoll() != 0) {
+        refreshHeader();
+    }
+}
+
+//! Location of record index, as rread() works it out.
+//
+static long recordAddress(int index) {
+    long location = getLocationOfCurrent() - (long) index * RecordSize;
+    if (location < BaseAddress) {
+        location += DeviceMemorySize - BaseAddress;
+    }
+    return location;
+}
+
+//! Room for n more bytes of replies for the client.
+//
+static char* reserve(struct client* c, size_t n) {
+    if (c->outlength + n > c->outsize) {
+        size_t size = c->outsize ? c->outsize : 1024;
+        while (size < c->outlength + n) {
+            size *= 2;
+        }
+        char* more = realloc(c->out, size);
+        if (more == NULL) {
+            printf("ERROR: unable to allocate server replies, aborting...\n");
+            exit(1);
+        }
+        c->out = more;
+        c->outsize = size;
+    }
+    char* space = c->out + c->outlength;
+    c->outlength += n;
+    return space;
+}
+
+//! Answer one request, appending the reply to the client's output.
+//
+static void answer(struct client* c, const struct serverRequest* request) {
+    struct serverReply reply = { request->op, ServerOK, 0, 0 };
+    size_t at = c->outlength;
+    reserve(c, sizeof(reply));
+
+    switch (request->op) {
+        case ServerRead:
+            if (request->argument >= DeviceMemorySize
+                    || request->argument + request->count > DeviceMemorySize) {
+                reply.status = ServerBadRequest;
+                break;
+            }
+            if (request->argument < BaseAddress) {
+                freshen();
+            }
+            reply.length = request->count;
+            if (dread(reserve(c, reply.length), request->argument, reply.length) != reply.length) {
+                reply.status = ServerDeviceError;
+            }
+            break;
+
+        case ServerHeader:
+            freshen();
+            reply.length = BaseAddress;
+            if (dread(reserve(c, reply.length), 0, reply.length) != reply.length) {
+                reply.status = ServerDeviceError;
+            }
+            break;
+
+        case ServerRecords: {
+            freshen();
+            long records = getRecordsStored();
+            long first = request->argument;
+            long count = request->count;
+            if (first >= records) {
+                count = 0;
+            }
+            else if (first + count > records) {
+                count = records - first;
+            }
+            reply.length = count * RecordSize;
+            char* data = reserve(c, reply.length);
+            for (long i = 0; i < count; i++) {
+                if (dread(data + i * RecordSize, recordAddress(first + i), RecordSize) != RecordSize) {
+                    reply.status = ServerDeviceError;
+                }
+            }
+            break;
+        }
+
+        default:
+            reply.status = ServerBadRequest;
+    }
+
+    if (reply.status != ServerOK) {
+        c->outlength = at + sizeof(reply);
+        reply.length = 0;
+    }
+    memcpy(c->out + at, &reply, sizeof(reply));
+}
+
+//! Note the blocks a memory read will need, so they can be read with the rest.
+//
+static void want(const struct serverRequest* request) {
+    if (request->op == ServerRead && request->argument + request->count <= DeviceMemorySize) {
+        dwant(request->argument, request->count);
+    }
+}
+
+static void dropClient(int i) {
+    close(clients[i].fd);
+    free(clients[i].out);
+    clients[i] = clients[--nclients];
+}
+
+//! Read what the client has sent, collecting each whole request for this round.
+//! Returns false when the client has gone.
+//
+static int readClient(struct client* c, struct serverRequest* requests, int* nrequests, int room) {
+    unsigned char buffer[ServerChunk];
+    ssize_t n = read(c->fd, buffer, sizeof(buffer));
+    if (n <= 0) {
+        return n < 0 && (errno == EINTR || errno == EAGAIN);
+    }
+
+    for (ssize_t i = 0; i < n; i++) {
+        c->in[c->have++] = buffer[i];
+        if (c->have == sizeof(struct serverRequest)) {
+            if (*nrequests == room) {
+                // more than a round's worth queued, answer what we have
+                for (int r = 0; r < *nrequests; r++) {
+                    answer(c, &requests[r]);
+                }
+                *nrequests = 0;
+            }
+            memcpy(&requests[(*nrequests)++], c->in, sizeof(struct serverRequest));
+            c->have = 0;
+        }
+    }
+    return true;
+}
+
+//! Write as much of the client's replies as it will take. Returns false when
+//! the client has gone.
+//
+static int writeClient(struct client* c) {
+    ssize_t n = send(c->fd, c->out + c->outsent, c->outlength - c->outsent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    c->outsent += n;
+    if (c->outsent == c->outlength) {
+        c->outsent = 0;
+        c->outlength = 0;
+    }
+    return true;
+}
+
+//! Listen on the socket and serve clients until SIGINT/SIGTERM.
+//
+void serve(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("ERROR: socket path %s is too long\n", path);
+        exit(1);
+    }
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        printf("ERROR: unable to create a socket, aborting...\n");
+        exit(1);
+    }
+
+    // a socket left by a server that has gone is replaced, a live one isn't
+    if (connect(listener, (struct sockaddr*) &address, sizeof(address)) == 0) {
+        printf("ERROR: a server is already running on %s\n", path);
+        exit(1);
+    }
+    unlink(path);
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0
+            || listen(listener, ServerClients) != 0) {
+        printf("ERROR: unable to listen on %s\n", path);
+        exit(1);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServing;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // where the device is now
+    dpoll();
+    refreshHeader();
+    polled = time(NULL);
+
+    struct pollfd fds[ServerClients + 1];
+    struct {
+        struct serverRequest request[ServerClients * 4];
+        int count;
+    } round[ServerClients];
+
+    while (serving) {
+        fds[0].fd = listener;
+        fds[0].events = (nclients < ServerClients) ? POLLIN : 0;
+        for (int i = 0; i < nclients; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN | (clients[i].outlength > 0 ? POLLOUT : 0);
+            fds[i + 1].revents = 0;
+        }
+
+        if (poll(fds, nclients + 1, -1) < 0) {
+            continue;       // interrupted
+        }
+
+        // take this round's requests from every client
+        int served = nclients;
+        for (int i = served - 1; i >= 0; i--) {
+            round[i].count = 0;
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (!readClient(&clients[i], round[i].request, &round[i].count, ServerClients * 4)) {
+                    // replace it by the last, whose requests are already in
+                    round[i] = round[--served];
+                    fds[i + 1] = fds[served + 1];
+                    dropClient(i);
+                }
+            }
+        }
+
+        // the blocks they need that aren't cached are read in one go, then they
+        // are all answered from the cache
+        for (int i = 0; i < served; i++) {
+            for (int r = 0; r < round[i].count; r++) {
+                want(&round[i].request[r]);
+            }
+        }
+        dfetch();
+        for (int i = 0; i < served; i++) {
+            for (int r = 0; r < round[i].count; r++) {
+                answer(&clients[i], &round[i].request[r]);
+            }
+        }
+
+        for (int i = served - 1; i >= 0; i--) {
+            if (clients[i].outlength > 0 && !writeClient(&clients[i])) {
+                dropClient(i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                memset(&clients[nclients], 0, sizeof(struct client));
+                clients[nclients++].fd = fd;
+            }
+        }
+    }
+
+    while (nclients > 0) {
+        dropClient(nclients - 1);
+    }
+    close(listener);
+    unlink(path);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   C L I E N T
+//
+
+static int server = -1;
+static long lastcurrent = -1;
+
+void sopen(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || connect(server, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        printf("ERROR: no wsrdr server on %s\n", path);
+        exit(1);
+    }
+}
+
+static void sfail() {
+    oflush();
+    printf("ERROR: lost the wsrdr server, aborting...\n");
+    exit(1);
+}
+
+static void sendAll(const void* data, size_t n) {
+    while (n > 0) {
+        ssize_t sent = send(server, data, n, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            sfail();
+        }
+        data = (const char*) data + sent;
+        n -= sent;
+    }
+}
+
+static void receiveAll(void* data, size_t n) {
+    while (n > 0) {
+        ssize_t got = read(server, data, n);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            sfail();
+        }
+        data = (char*) data + got;
+        n -= got;
+    }
+}
+
+//! Reads are asked for ServerChunk at a time, all sent before the first reply is
+//! waited for. Every reply is taken in, even after one has failed, so that none
+//! are left in the socket to be taken for the replies to a later read.
+//
+int sread(char* buffer, long location, int size) {
+    if (location < 0 || location >= DeviceMemorySize) {
+        return 0;
+    }
+    if (location + size > DeviceMemorySize) {
+        size = DeviceMemorySize - location;
+    }
+
+    int chunks = (size + ServerChunk - 1) / ServerChunk;
+    for (int i = 0; i < chunks; i++) {
+        int n = (size - i * ServerChunk < ServerChunk) ? size - i * ServerChunk : ServerChunk;
+        struct serverRequest request = { ServerRead, 0, n, location + i * ServerChunk };
+        sendAll(&request, sizeof(request));
+    }
+
+    int bytes = 0;
+    int failed = 0;
+    for (int i = 0; i < chunks; i++) {
+        struct serverReply reply;
+        receiveAll(&reply, sizeof(reply));
+        if (reply.length > ServerChunk) {
+            sfail();
+        }
+        if (failed || reply.status != ServerOK) {
+            char scratch[ServerChunk];
+            receiveAll(scratch, reply.length);
+            failed = 1;
+            continue;
+        }
+        receiveAll(buffer + bytes, reply.length);
+        bytes += reply.length;
+    }
+    return failed ? -1 : bytes;
+}
+
+//! The server keeps up with the device, so only the current record pointer it
+//! reports needs watching.
+//
+int spoll() {
+    unsigned char current[2];
+    if (sread((char*) current, L_CURRENT, 2) != 2) {
+        return -1;
+    }
+    long location = current[0] | (current[1] << 8);
+
+    int saved = -1;
+    if (lastcurrent >= 0) {
+        long distance = location - lastcurrent;
+        if (distance < 0) {
+            distance += DeviceMemorySize - BaseAddress;
+        }
+        saved = distance / RecordSize;
+    }
+    lastcurrent = location;
+    return saved;
+}
+
+void sbaseline(long current) {
+    lastcurrent = current;
+}
+
+void sclose() {
+    if (server >= 0) {
+        close(server);
+        server = -1;
+    }
+}
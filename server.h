@@ -0,0 +1,64 @@
+/*
+ * File:   server.h
+ *
+ * Serves device memory over a unix domain socket (-D path), and the client
+ * end of it used by dfile.c for -F :sock:path.
+ */
+
+// V0.1
+
+#ifndef _SERVER_H
+#define	_SERVER_H
+
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // requests, all fields little endian
+    struct serverRequest {
+        uint8_t     op;                 // one of the Server... ops below
+        uint8_t     reserved;
+        uint16_t    count;              // bytes (ServerRead) or records (ServerRecords)
+        uint32_t    argument;           // location (ServerRead) or first record index
+    };
+
+    // each request gets a reply of this followed by length bytes of data
+    struct serverReply {
+        uint8_t     op;                 // as requested
+        uint8_t     status;             // one of the Server... statuses below
+        uint16_t    reserved;
+        uint32_t    length;
+    };
+
+    #define ServerRead          1       // count bytes of device memory from argument
+    #define ServerHeader        2       // the header (0x000 - 0x0FF), checked for new records
+    #define ServerRecords       3       // count raw records from index argument (0 = current)
+
+    #define ServerOK            0
+    #define ServerBadRequest    1
+    #define ServerDeviceError   2
+
+    // serve the open device (or file) on the socket until SIGINT/SIGTERM
+    void serve(const char* path);
+
+    // client end: connect to a server, exits if there isn't one
+    void sopen(const char* path);
+
+    // read size bytes of device memory from location through the server
+    int sread(char* buffer, long location, int size);
+
+    // records saved since the last call (-1 on the first), as dpoll()
+    int spoll();
+
+    // take current as where the last call left off, see dbaseline()
+    void sbaseline(long current);
+
+    void sclose();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SERVER_H */
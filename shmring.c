@@ -0,0 +1,292 @@
+/*
+ *! shmring.c
+ *!
+ *! Publishes listed records in a POSIX shared memory segment, for local
+ *! processes that only want the newest readings and want them without a
+ *! round trip through a socket or a database (-o shm:name, usually with
+ *! --follow, fed from whatever dread() reads).
+ *!
+ *! The segment is a ring of ShmSlots decoded records (struct shmRecord) with
+ *! one writer and any number of readers, and no locks: each slot has a seqlock
+ *! word that is odd while the record in it is being written and 2 * its
+ *! sequence number once it is there. A reader copies the record and then checks
+ *! the word hasn't changed; if it has the record was overwritten and is skipped.
+ *! Attaching maps the segment, after that reading is plain loads, no syscalls.
+ *!
+ *! A listing comes newest first, so records are held until shmflush() (at the
+ *! end of a listing and after each --follow poll) and then published oldest
+ *! first. Records no newer than the last published are dropped, so overlapping
+ *! runs don't publish a record twice, and a new publisher carries on the
+ *! numbering of the segment it finds.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "header.h"
+#include "wrecord.h"
+#include "shmring.h"
+
+static const char ShmMagic[8] = "WSRDRSHM";
+
+static struct shmRing* ring = NULL;
+static size_t ringsize = 0;
+
+static struct shmRecord pending[ShmSlots];
+static int npending = 0;
+
+
+//! Segment names are given without the leading / shm_open() wants.
+//
+static void shmpath(char* path, size_t size, const char* name) {
+    snprintf(path, size, "%s%s", (*name == '/') ? "" : "/", name);
+}
+
+static size_t shmsize(uint32_t slots) {
+    return sizeof(struct shmRing) + (size_t) slots * sizeof(struct shmSlot);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   P U B L I S H E R
+//
+
+void shmopen(const char* name) {
+    char path[256];
+    shmpath(path, sizeof(path), name);
+
+    int fd = shm_open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        printf("ERROR: unable to open shared memory %s\n", path);
+        exit(1);
+    }
+
+    ringsize = shmsize(ShmSlots);
+    struct stat st;
+    int reuse = (fstat(fd, &st) == 0 && st.st_size == (off_t) ringsize);
+    if (!reuse && ftruncate(fd, ringsize) != 0) {
+        printf("ERROR: unable to size shared memory %s\n", path);
+        exit(1);
+    }
+
+    ring = mmap(NULL, ringsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        printf("ERROR: unable to map shared memory %s\n", path);
+        exit(1);
+    }
+
+    // carry on from a ring of ours, anything else starts empty
+    if (!reuse || memcmp(ring->magic, ShmMagic, sizeof(ShmMagic)) != 0
+            || ring->slots != ShmSlots || ring->slotSize != sizeof(struct shmSlot)) {
+        memset(ring, 0, ringsize);
+        ring->slots = ShmSlots;
+        ring->slotSize = sizeof(struct shmSlot);
+        memcpy(ring->magic, ShmMagic, sizeof(ShmMagic));
+    }
+}
+
+void shmrecord(weatherRecordPtr record, time_t time) {
+    struct shmRecord r;
+    memset(&r, 0, sizeof(r));
+    r.time        = time;
+    r.memPos      = record->memPos;
+    r.interval    = record->interval;
+    r.humIn       = record->humIn;
+    r.humOut      = record->humOut;
+    r.windDir     = record->windDir;
+    r.rainCounter = getUnsignedInt((char*) record->rawdata + 0x0D);
+    r.errorCode   = record->errorCode;
+    r.tempIn      = record->tempIn;
+    r.tempOut     = record->tempOut;
+    r.press       = record->press;
+    r.windSpeed   = record->windSpeed;
+    r.gustSpeed   = record->gustSpeed;
+    memcpy(r.rawdata, record->rawdata, sizeof(r.rawdata));
+
+    if (npending < ShmSlots) {
+        pending[npending++] = r;
+        return;
+    }
+
+    // more than the ring holds, keep the newest
+    int oldest = 0;
+    for (int i = 1; i < npending; i++) {
+        if (pending[i].time < pending[oldest].time) {
+            oldest = i;
+        }
+    }
+    if (r.time > pending[oldest].time) {
+        pending[oldest] = r;
+    }
+}
+
+static int bytime(const void* a, const void* b) {
+    int64_t ta = ((const struct shmRecord*) a)->time;
+    int64_t tb = ((const struct shmRecord*) b)->time;
+    return (ta > tb) - (ta < tb);
+}
+
+//! Put a record in the next slot: the seqlock word goes odd, the record is
+//! written, the word goes to 2 * sequence, then the head moves on.
+//
+static void publish(struct shmRecord* r) {
+    uint64_t sequence = ring->head + 1;
+    struct shmSlot* slot = &ring->slot[sequence % ring->slots];
+
+    r->sequence = sequence;
+    __atomic_store_n(&slot->lock, 2 * sequence - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->record = *r;
+    __atomic_store_n(&slot->lock, 2 * sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, sequence, __ATOMIC_RELEASE);
+}
+
+void shmflush() {
+    if (ring == NULL || npending == 0) {
+        return;
+    }
+
+    qsort(pending, npending, sizeof(struct shmRecord), bytime);
+
+    int64_t last = INT64_MIN;
+    if (ring->head > 0) {
+        last = ring->slot[ring->head % ring->slots].record.time;
+    }
+    for (int i = 0; i < npending; i++) {
+        if (pending[i].time > last) {
+            publish(&pending[i]);
+            last = pending[i].time;
+        }
+    }
+    npending = 0;
+}
+
+void shmclose() {
+    if (ring == NULL) {
+        return;
+    }
+    shmflush();
+    munmap(ring, ringsize);
+    ring = NULL;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   R E A D E R
+//
+
+int shmattach(struct shmReader* reader, const char* name) {
+    char path[256];
+    shmpath(path, sizeof(path), name);
+    reader->ring = NULL;
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(struct shmRing)) {
+        close(fd);
+        return false;
+    }
+    const struct shmRing* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    if (memcmp(mapped->magic, ShmMagic, sizeof(ShmMagic)) != 0 || mapped->slots < 2
+            || mapped->slotSize != sizeof(struct shmSlot) || (size_t) st.st_size < shmsize(mapped->slots)) {
+        munmap((void*) mapped, st.st_size);
+        return false;
+    }
+
+    reader->ring = mapped;
+    reader->size = st.st_size;
+
+    // the oldest record held that the writer can't be part way through replacing
+    uint64_t head = __atomic_load_n(&mapped->head, __ATOMIC_ACQUIRE);
+    reader->next = (head >= mapped->slots) ? head - mapped->slots + 2 : 1;
+    return true;
+}
+
+//! Copy record sequence out of its slot, false if it isn't (still) there.
+//
+static int shmcopy(const struct shmRing* ring, uint64_t sequence, struct shmRecord* record) {
+    const struct shmSlot* slot = &ring->slot[sequence % ring->slots];
+
+    uint64_t before = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+    if (before != 2 * sequence) {
+        return false;
+    }
+    *record = slot->record;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == before;
+}
+
+int shmnext(struct shmReader* reader, struct shmRecord* record) {
+    const struct shmRing* ring = reader->ring;
+
+    for (;;) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (reader->next > head) {
+            return false;
+        }
+        // lapped: the writer has gone round past us
+        if (head - reader->next >= ring->slots - 1) {
+            reader->next = head - ring->slots + 2;
+        }
+        if (shmcopy(ring, reader->next, record)) {
+            reader->next++;
+            return true;
+        }
+    }
+}
+
+int shmlatest(struct shmReader* reader, struct shmRecord* record) {
+    const struct shmRing* ring = reader->ring;
+
+    for (;;) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == 0) {
+            return false;
+        }
+        if (shmcopy(ring, head, record)) {
+            return true;
+        }
+    }
+}
+
+void shmdetach(struct shmReader* reader) {
+    if (reader->ring != NULL) {
+        munmap((void*) reader->ring, reader->size);
+        reader->ring = NULL;
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * File:   shmring.h
+ *
+ * Publishes records to a POSIX shared memory ring (-o shm:name), and the reader
+ * end for the processes that use them.
+ */
+
+// V0.1
+
+#ifndef _SHMRING_H
+#define	_SHMRING_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "wrecord.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // a decoded record as published
+    struct shmRecord {
+        uint64_t        sequence;       // 1 for the first record published, and so on
+        int64_t         time;           // UTC seconds
+        uint32_t        memPos;
+        uint32_t        interval;
+        uint32_t        humIn;
+        uint32_t        humOut;
+        uint32_t        windDir;
+        uint32_t        rainCounter;    // rain gauge tips (0.3mm each), the device's 16 bit count
+        uint32_t        errorCode;
+        double          tempIn;
+        double          tempOut;
+        double          press;
+        double          windSpeed;
+        double          gustSpeed;
+        unsigned char   rawdata[16];
+    };
+
+    // seqlock word: 2 * sequence once the record is there, odd while it's written
+    struct shmSlot {
+        uint64_t        lock;
+        struct shmRecord record;
+    };
+
+    // the segment (/dev/shm/name)
+    struct shmRing {
+        char            magic[8];       // "WSRDRSHM"
+        uint32_t        slots;
+        uint32_t        slotSize;       // sizeof(struct shmSlot)
+        uint64_t        head;           // sequence of the newest record published
+        char            reserved[40];
+        struct shmSlot  slot[];         // record n is in slot[n % slots]
+    };
+
+    // publisher: create (or take over) the segment
+    void shmopen(const char* name);
+
+    // add a record saved at the given time, published by shmflush()
+    void shmrecord(weatherRecordPtr record, time_t time);
+
+    // publish the records added, oldest first, skipping any already published
+    void shmflush();
+
+    // publish what is outstanding and let go of the segment (it stays for readers)
+    void shmclose();
+
+    struct shmReader {
+        const struct shmRing*   ring;
+        size_t                  size;
+        uint64_t                next;   // sequence shmnext() returns next
+    };
+
+    // map the segment, positioned at the oldest record it holds; false if there isn't one
+    int shmattach(struct shmReader* reader, const char* name);
+
+    // copy the next record, true if there was one (records overwritten are skipped)
+    int shmnext(struct shmReader* reader, struct shmRecord* record);
+
+    // copy the newest record, true if there is one
+    int shmlatest(struct shmReader* reader, struct shmRecord* record);
+
+    void shmdetach(struct shmReader* reader);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SHMRING_H */
@@ -0,0 +1,316 @@
+/*
+ *! simdev.c
+ *!
+ *! A stand-in for the station: 32 byte blocks are served from a memory image
+ *! the way the usb device serves them, so chstream caching, read ordering and
+ *! --follow polling can be measured (and regression tested) without hardware.
+ *! Selected with dopen(":sim:image.bin[,key=value...]"), where the keys are
+ *!
+ *!     latency=us      time each transfer takes (default 0)
+ *!     jitter=us       transfers take latency +/- up to this, at random
+ *!     interval=s      virtual seconds between records being saved (default
+ *!                     the image's storage interval, 0 to stop the ring)
+ *!     update=s        virtual seconds between updates of record 0 (default 48)
+ *!     short=pct       percentage of transfers that come back short
+ *!     realtime=1      really wait out each transfer, and let the virtual clock
+ *!                     follow the wall clock (so --follow sees records saved)
+ *!     seed=n          for the jitter, short reads and readings
+ *!     report=1        print the transfer counts when the device is closed
+ *!
+ *! The virtual clock moves on by the time each transfer takes. Before a block
+ *! is served the image is brought up to the clock: record 0 is updated every
+ *! update seconds and every interval seconds it is saved, moving L_CURRENT on
+ *! round the ring, counting it in L_RECORDS and dating the header (L_DATETIME)
+ *! as a station does.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "utctime.h"
+#include "usbdrv.h"
+#include "simdev.h"
+
+#define SimUpdate       48              // seconds between updates of record 0, as a WH1081
+#define SimShort        8               // bytes a short read delivers
+
+static unsigned char memory[DeviceMemorySize];
+
+static struct {
+    long        latency;
+    long        jitter;
+    long        interval;               // seconds, 0 = the ring doesn't move
+    long        update;
+    int         shortPercent;
+    int         realtime;
+    int         report;
+    unsigned long seed;
+} settings = { 0, 0, -1, SimUpdate, 0, 0, 0, 1 };
+
+static struct simCounters counters;
+
+static long long nextSave;              // virtual clock times of the next events
+static long long nextUpdate;
+static long long lastSave;
+static time_t startTime;                // device date & time when the clock was 0
+static struct timespec wallStart;
+
+
+//! A small deterministic generator, so runs with the same seed read the same.
+//
+static unsigned long simrandom() {
+    settings.seed = settings.seed * 6364136223846793005UL + 1442695040888963407UL;
+    return settings.seed >> 33;
+}
+
+static unsigned int get16(int location) {
+    return memory[location] | (memory[location + 1] << 8);
+}
+
+static void put16(int location, unsigned int value) {
+    memory[location] = value & 0xFF;
+    memory[location + 1] = (value >> 8) & 0xFF;
+}
+
+static int frombcd(unsigned char b) {
+    return (b >> 4) * 10 + (b & 0x0F);
+}
+
+static unsigned char tobcd(int v) {
+    return ((v / 10) << 4) | (v % 10);
+}
+
+//! The header date & time (yy mm dd hh mm in bcd) as a time_t and back.
+//
+static time_t headerTime() {
+    const unsigned char* d = memory + L_DATETIME;
+    long days = daysFromCivil(2000 + frombcd(d[0]), frombcd(d[1]), frombcd(d[2]));
+    return days * 86400 + frombcd(d[3]) * 3600 + frombcd(d[4]) * 60;
+}
+
+static void setHeaderTime(time_t time) {
+    int year, month, day;
+    civilFromDays(time / 86400, &year, &month, &day);
+    int minute = (time % 86400) / 60;
+
+    unsigned char* d = memory + L_DATETIME;
+    d[0] = tobcd(year % 100);
+    d[1] = tobcd(month);
+    d[2] = tobcd(day);
+    d[3] = tobcd(minute / 60);
+    d[4] = tobcd(minute % 60);
+}
+
+void simconfigure(const char* spec) {
+    char path[1024];
+    size_t length = strcspn(spec, ",");
+    if (length >= sizeof(path)) {
+        printf("ERROR: simulator image name too long\n");
+        exit(1);
+    }
+    memcpy(path, spec, length);
+    path[length] = '\0';
+
+    for (const char* p = spec + length; *p == ','; p += strcspn(p + 1, ",") + 1) {
+        char key[16];
+        long value;
+        if (sscanf(p + 1, "%15[a-z]=%ld", key, &value) != 2) {
+            printf("ERROR: bad simulator setting %s\n", p + 1);
+            exit(1);
+        }
+        if (strcmp(key, "latency") == 0)        settings.latency = value;
+        else if (strcmp(key, "jitter") == 0)    settings.jitter = value;
+        else if (strcmp(key, "interval") == 0)  settings.interval = value;
+        else if (strcmp(key, "update") == 0)    settings.update = value;
+        else if (strcmp(key, "short") == 0)     settings.shortPercent = value;
+        else if (strcmp(key, "realtime") == 0)  settings.realtime = value;
+        else if (strcmp(key, "seed") == 0)      settings.seed = value;
+        else if (strcmp(key, "report") == 0)    settings.report = value;
+        else {
+            printf("ERROR: unknown simulator setting %s\n", key);
+            exit(1);
+        }
+    }
+
+    // images written by -w stop after the current record, the rest is zero
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("ERROR: unable to open simulator image %s\n", path);
+        exit(1);
+    }
+    if (fread(memory, 1, sizeof(memory), f) < BaseAddress) {
+        printf("ERROR: simulator image %s has no header\n", path);
+        exit(1);
+    }
+    fclose(f);
+
+    if (settings.interval < 0) {
+        settings.interval = get16(L_INTERVAL) * 60L;
+    }
+}
+
+const struct simCounters* simcounters() {
+    return &counters;
+}
+
+//! Record 0 is rewritten with the minutes since the last save and fresh readings.
+//
+static void updateCurrent() {
+    unsigned char* record = memory + get16(L_CURRENT);
+
+    record[0] = (counters.clock - lastSave) / 60000000LL;
+
+    // wander the outside humidity and the wind a little
+    int humidity = record[4] + (int) (simrandom() % 3) - 1;
+    record[4] = (humidity < 1) ? 1 : (humidity > 99) ? 99 : humidity;
+    record[9] = simrandom() % 40;
+
+    counters.updates++;
+}
+
+//! Record 0 is saved: the next record along the ring becomes current, starting
+//! as a copy of it.
+//
+static void saveCurrent(long long when) {
+    int current = get16(L_CURRENT);
+    memory[current] = settings.interval / 60;
+
+    int next = current + RecordSize;
+    if (next >= DeviceMemorySize) {
+        next = BaseAddress;
+    }
+    memcpy(memory + next, memory + current, RecordSize);
+    memory[next] = 0;
+
+    put16(L_CURRENT, next);
+    if (get16(L_RECORDS) < MaxRecords) {
+        put16(L_RECORDS, get16(L_RECORDS) + 1);
+    }
+    lastSave = when;
+    counters.saves++;
+}
+
+//! Bring the image up to the virtual clock.
+//
+static void advance() {
+    if (settings.realtime) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        counters.clock = (now.tv_sec - wallStart.tv_sec) * 1000000LL + (now.tv_nsec - wallStart.tv_nsec) / 1000;
+    }
+
+    for (;;) {
+        int saving = (settings.interval > 0);
+        int updating = (settings.update > 0);
+
+        if (saving && nextSave <= counters.clock && (!updating || nextSave <= nextUpdate)) {
+            saveCurrent(nextSave);
+            nextSave += settings.interval * 1000000LL;
+        }
+        else if (updating && nextUpdate <= counters.clock) {
+            updateCurrent();
+            nextUpdate += settings.update * 1000000LL;
+        }
+        else {
+            break;
+        }
+    }
+    setHeaderTime(startTime + counters.clock / 1000000);
+}
+
+//! One transfer: the time it takes goes on the clock, and it may come back short.
+//! Returns the bytes delivered.
+//
+static int transfer(char* buffer, long location) {
+    long cost = settings.latency;
+    if (settings.jitter > 0) {
+        cost += (long) (simrandom() % (2 * settings.jitter + 1)) - settings.jitter;
+        if (cost < 0) {
+            cost = 0;
+        }
+    }
+    counters.latency += cost;
+    if (settings.realtime) {
+        usleep(cost);
+    }
+    else {
+        counters.clock += cost;
+    }
+    advance();
+
+    int bytes = ReadBufferSize;
+    if (settings.shortPercent > 0 && (int) (simrandom() % 100) < settings.shortPercent) {
+        bytes = SimShort;
+        counters.shortReads++;
+    }
+
+    long start = location & ~(long) (ReadBufferSize - 1);
+    memcpy(buffer, memory + start, bytes);
+    counters.transfers++;
+    counters.bytes += bytes;
+    return bytes;
+}
+
+static void simopen() {
+    memset(&counters, 0, sizeof(counters));
+    startTime = headerTime();
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    lastSave = -(long long) memory[get16(L_CURRENT)] * 60000000LL;
+    nextSave = lastSave + settings.interval * 1000000LL;
+    if (nextSave < 0) {
+        // record 0 is older than the interval, so it is saved straight away
+        nextSave = 0;
+    }
+    nextUpdate = settings.update * 1000000LL;
+}
+
+static int simreadbytes(char* buffer, long location) {
+    return transfer(buffer, location);
+}
+
+static int simreadblocks(const long* locations, int count, usbBlockHandler handler, void* context) {
+    char data[ReadBufferSize];
+    int complete = 0;
+
+    for (int i = 0; i < count; i++) {
+        int bytes = transfer(data, locations[i]);
+        handler(context, locations[i], data, bytes);
+        if (bytes == ReadBufferSize) {
+            complete++;
+        }
+    }
+    return complete;
+}
+
+static void simclose() {
+    if (settings.report) {
+        fprintf(stderr, "sim: transfers=%ld short=%ld bytes=%lld latency=%lldus clock=%lldus saves=%ld updates=%ld\n",
+                counters.transfers, counters.shortReads, counters.bytes, counters.latency,
+                counters.clock, counters.saves, counters.updates);
+    }
+}
+
+const struct usbBackend simDevice = { simopen, simreadbytes, simreadblocks, simclose };
@@ -0,0 +1,42 @@
+/*
+ * File:   simdev.h
+ *
+ * A simulated WH1081 served from a memory image (:sim:image.bin[,key=value...]),
+ * for measuring wsrdr without a station plugged in.
+ */
+
+// V0.1
+
+#ifndef _SIMDEV_H
+#define	_SIMDEV_H
+
+#include "usbdrv.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // every simulated transfer is counted
+    struct simCounters {
+        long        transfers;          // block reads asked for
+        long        shortReads;         // of which came back short
+        long long   bytes;              // bytes delivered
+        long long   latency;            // microseconds of modelled transfer time
+        long long   clock;              // microseconds on the virtual clock
+        long        saves;              // records saved (the ring moved on)
+        long        updates;            // updates of record 0
+    };
+
+    // load the image and settings from the spec after :sim:, exits if it can't
+    void simconfigure(const char* spec);
+
+    const struct simCounters* simcounters();
+
+    // the simulator as chstream's block source (see ubackend())
+    extern const struct usbBackend simDevice;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SIMDEV_H */
@@ -0,0 +1,181 @@
+/*
+ *! sqlsink.c
+ *!
+ *! Writes listed records straight into an sqlite3 database, rather than
+ *! listing them for a script to insert. One INSERT is prepared when the
+ *! database is opened and the fields of each record are bound to it; rows go
+ *! in SqlBatch to a transaction, with the journal in WAL mode.
+ *!
+ *! A record is identified by its time and memory location, and storing one
+ *! again updates it, so runs that overlap (or are repeated) don't duplicate.
+ *! The time is when the record was saved, whichever listing (-r, -s, -I or
+ *! --follow) it came from (see emitRecord() in main.c). Times are stored as
+ *! UTC "YYYY-MM-DD HH:MM" text, as sqlite3 likes them. rainCounter is the
+ *! device's 16 bit counter as it is held.
+ *!
+ *! Build with -DNO_SQLITE for a wsrdr without it (-o sqlite: then fails).
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "header.h"
+#include "wrecord.h"
+#include "utctime.h"
+#include "sqlsink.h"
+
+#ifndef NO_SQLITE
+
+#include <sqlite3.h>
+
+#define SqlBatch        10000           // rows per transaction
+
+static sqlite3* db = NULL;
+static sqlite3_stmt* insert = NULL;
+static int pending = 0;                 // rows in the open transaction
+
+static const char* createTable =
+    "CREATE TABLE IF NOT EXISTS records ("
+    " timestamp TEXT NOT NULL,"
+    " memPos INTEGER NOT NULL,"
+    " interval INTEGER,"
+    " humIn INTEGER,"
+    " tempIn REAL,"
+    " humOut INTEGER,"
+    " tempOut REAL,"
+    " press REAL,"
+    " windSpeed REAL,"
+    " gustSpeed REAL,"
+    " windDir INTEGER,"
+    " rainCounter INTEGER,"
+    " errorCode INTEGER,"
+    " PRIMARY KEY (timestamp, memPos))";
+
+static const char* insertRecord =
+    "INSERT INTO records (timestamp, memPos, interval, humIn, tempIn, humOut, tempOut,"
+    " press, windSpeed, gustSpeed, windDir, rainCounter, errorCode)"
+    " VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13)"
+    " ON CONFLICT (timestamp, memPos) DO UPDATE SET"
+    " interval = excluded.interval, humIn = excluded.humIn, tempIn = excluded.tempIn,"
+    " humOut = excluded.humOut, tempOut = excluded.tempOut, press = excluded.press,"
+    " windSpeed = excluded.windSpeed, gustSpeed = excluded.gustSpeed,"
+    " windDir = excluded.windDir, rainCounter = excluded.rainCounter,"
+    " errorCode = excluded.errorCode";
+
+
+//! Report an sqlite3 failure and give up.
+//
+static void sqlfail(const char* doing) {
+    printf("ERROR: sqlite3 %s failed: %s, aborting...\n", doing, db ? sqlite3_errmsg(db) : "out of memory");
+    exit(1);
+}
+
+static void sqlexec(const char* sql) {
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        sqlfail(sql);
+    }
+}
+
+void sqlopen(const char* path) {
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        sqlfail("open");
+    }
+    sqlite3_busy_timeout(db, 5000);
+
+    sqlexec("PRAGMA journal_mode = WAL");
+    sqlexec("PRAGMA synchronous = NORMAL");
+    sqlexec(createTable);
+
+    if (sqlite3_prepare_v2(db, insertRecord, -1, &insert, NULL) != SQLITE_OK) {
+        sqlfail("prepare");
+    }
+}
+
+void sqlrecord(weatherRecordPtr record, time_t time) {
+    char timestamp[17];
+
+    if (pending == 0) {
+        sqlexec("BEGIN");
+    }
+
+    utcFormat(timestamp, time);
+    sqlite3_bind_text(insert, 1, timestamp, 16, SQLITE_TRANSIENT);
+    sqlite3_bind_int(insert, 2, record->memPos);
+    sqlite3_bind_int(insert, 3, record->interval);
+    sqlite3_bind_int(insert, 4, record->humIn);
+    sqlite3_bind_double(insert, 5, record->tempIn);
+    sqlite3_bind_int(insert, 6, record->humOut);
+    sqlite3_bind_double(insert, 7, record->tempOut);
+    sqlite3_bind_double(insert, 8, record->press);
+    sqlite3_bind_double(insert, 9, record->windSpeed);
+    sqlite3_bind_double(insert, 10, record->gustSpeed);
+    sqlite3_bind_int(insert, 11, record->windDir);
+    sqlite3_bind_int(insert, 12, getUnsignedInt((char*) record->rawdata + 0x0D));
+    sqlite3_bind_int(insert, 13, record->errorCode);
+
+    if (sqlite3_step(insert) != SQLITE_DONE) {
+        sqlfail("insert");
+    }
+    sqlite3_reset(insert);
+
+    if (++pending == SqlBatch) {
+        sqlexec("COMMIT");
+        pending = 0;
+    }
+}
+
+void sqlflush() {
+    if (db != NULL && pending > 0) {
+        sqlexec("COMMIT");
+        pending = 0;
+    }
+}
+
+void sqlclose() {
+    if (db == NULL) {
+        return;
+    }
+    sqlflush();
+    sqlite3_finalize(insert);
+    sqlite3_close(db);
+    insert = NULL;
+    db = NULL;
+}
+
+#else // NO_SQLITE
+
+void sqlopen(const char* path) {
+    printf("ERROR: this wsrdr was built without sqlite3, can't write %s\n", path);
+    exit(1);
+}
+
+void sqlrecord(weatherRecordPtr record, time_t time) {
+}
+
+void sqlflush() {
+}
+
+void sqlclose() {
+}
+
+#endif // NO_SQLITE
@@ -0,0 +1,37 @@
+/*
+ * File:   sqlsink.h
+ *
+ * Stores listed records in an sqlite3 database (-o sqlite:path).
+ */
+
+// V0.1
+
+#ifndef _SQLSINK_H
+#define	_SQLSINK_H
+
+#include <time.h>
+
+#include "wrecord.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // open (creating if need be) the database and its records table
+    void sqlopen(const char* path);
+
+    // store a record saved at the given time, replacing any stored before
+    // with the same time and memory location
+    void sqlrecord(weatherRecordPtr record, time_t time);
+
+    // commit the rows stored so far, for --follow
+    void sqlflush();
+
+    // commit what is outstanding and close the database
+    void sqlclose();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SQLSINK_H */
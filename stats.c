@@ -0,0 +1,120 @@
+/*
+ *! stats.c
+ *!
+ *! With --stats wsrdr says what it did on the way out: how many usb transfers
+ *! it made, the bytes and retries and how long the replies took (a histogram of
+ *! latencies doubling from 64us), how long _init_wread() took, how many ugetc()
+ *! calls found their block in the chstream cache and how many blocks had to be
+ *! read (and of those how many were read ahead), what dread() was asked for,
+ *! and the records decoded and rows listed.
+ *!
+ *! Each layer keeps its own counts all the time (usbstats(), ustats(), dstats()
+ *! and rstats()), they are plain increments so cost nothing worth switching
+ *! off; this only gathers and prints them, on stderr so the listing on stdout
+ *! is left as it is. --stats=json prints them as one line of JSON for cron jobs
+ *! to append to a log.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "config.h"
+#include "usbdrv.h"
+#include "chstream.h"
+#include "dfile.h"
+#include "wrecord.h"
+#include "stats.h"
+
+static struct timespec started;
+
+
+void statsstart() {
+    clock_gettime(CLOCK_MONOTONIC, &started);
+}
+
+static long long runMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - started.tv_sec) * 1000000LL + (now.tv_nsec - started.tv_nsec) / 1000;
+}
+
+static void reportText(long long run, const struct usbStats* usb, const struct streamStats* stream,
+                       const struct fileStats* file, const struct recordStats* records) {
+    fprintf(stderr, "stats: %.3fs\n", run / 1e6);
+    fprintf(stderr, "usb       transfers=%ld bytes=%lld retries=%ld short=%ld failed=%ld init=%.1fms\n",
+            usb->transfers, usb->bytes, usb->retries, usb->shortReads, usb->failures, usb->initMicros / 1e3);
+    if (usb->transfers > 0) {
+        fprintf(stderr, "usb       latency mean=%.2fms max=%.2fms",
+                usb->latencyTotal / 1e3 / usb->transfers, usb->latencyMax / 1e3);
+        for (int i = 0; i < UsbLatencyBuckets; i++) {
+            if (usb->latency[i] == 0) {
+                continue;
+            }
+            if (i < UsbLatencyBuckets - 1) {
+                fprintf(stderr, " <%ldus=%ld", UsbLatencyBucket(i), usb->latency[i]);
+            }
+            else {
+                fprintf(stderr, " >=%ldus=%ld", UsbLatencyBucket(i - 1), usb->latency[i]);
+            }
+        }
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "chstream  hits=%ld misses=%ld batches=%ld blocks=%ld failed=%ld readahead=%ld\n",
+            stream->hits, stream->misses, stream->batches, stream->blocks, stream->failed, stream->readAhead);
+    fprintf(stderr, "dfile     calls=%ld bytes=%lld\n", file->calls, file->bytes);
+    fprintf(stderr, "records   decoded=%ld rows=%ld\n", records->decoded, records->rows);
+}
+
+static void reportJson(long long run, const struct usbStats* usb, const struct streamStats* stream,
+                       const struct fileStats* file, const struct recordStats* records) {
+    fprintf(stderr, "{\"run_us\":%lld,\"usb\":{\"transfers\":%ld,\"bytes\":%lld,\"retries\":%ld,"
+            "\"short\":%ld,\"failed\":%ld,\"init_us\":%lld,\"latency_us\":{\"total\":%lld,\"max\":%lld,"
+            "\"buckets\":[", run, usb->transfers, usb->bytes, usb->retries, usb->shortReads,
+            usb->failures, usb->initMicros, usb->latencyTotal, usb->latencyMax);
+
+    // [upper bound, count], the last bucket has no bound
+    for (int i = 0; i < UsbLatencyBuckets; i++) {
+        if (i < UsbLatencyBuckets - 1) {
+            fprintf(stderr, "%s[%ld,%ld]", (i > 0) ? "," : "", UsbLatencyBucket(i), usb->latency[i]);
+        }
+        else {
+            fprintf(stderr, ",[null,%ld]", usb->latency[i]);
+        }
+    }
+
+    fprintf(stderr, "]}},\"chstream\":{\"hits\":%ld,\"misses\":%ld,\"batches\":%ld,\"blocks\":%ld,\"failed\":%ld,\"readahead\":%ld},"
+            "\"dfile\":{\"calls\":%ld,\"bytes\":%lld},\"records\":{\"decoded\":%ld,\"rows\":%ld}}\n",
+            stream->hits, stream->misses, stream->batches, stream->blocks, stream->failed, stream->readAhead,
+            file->calls, file->bytes, records->decoded, records->rows);
+}
+
+void statsreport(int format) {
+    long long run = runMicros();
+
+    if (format == StatsJson) {
+        reportJson(run, usbstats(), ustats(), dstats(), rstats());
+    }
+    else {
+        reportText(run, usbstats(), ustats(), dstats(), rstats());
+    }
+    fflush(stderr);
+}
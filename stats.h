@@ -0,0 +1,30 @@
+/*
+ * File:   stats.h
+ *
+ * What a run did, layer by layer (--stats): the usb transfers and their
+ * latencies, the chstream cache, dread() and the records listed.
+ */
+
+// V0.1
+
+#ifndef _STATS_H
+#define	_STATS_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    #define StatsText       0
+    #define StatsJson       1
+
+    // start the run clock
+    void statsstart();
+
+    // print the counts on stderr, as text or as one line of JSON
+    void statsreport(int format);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _STATS_H */
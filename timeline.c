@@ -0,0 +1,191 @@
+/*
+ *! timeline.c
+ *!
+ *! --trace out.json records where the time of a run went as spans: opening the
+ *! device and _init_wread(), each usb transfer (from its read command to the
+ *! reply, on the usb event thread), the blocks chstream reads, header reads and
+ *! polls, listings and record decoding, and output and sink flushes. When the
+ *! run ends they are written in the Chrome Trace Event Format, which trace
+ *! viewers (chrome://tracing, Perfetto) load as a timeline per thread, to see
+ *! whether a slow run is waiting on the device, reading the header again or
+ *! formatting.
+ *!
+ *! Recording a span takes no lock: each thread appends to its own buffer, and
+ *! a thread's buffers are added to the list of all of them with a compare and
+ *! swap. The file is written from the list at the end. Spans are only recorded
+ *! while timing is true, so the points they are taken at cost a test otherwise.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "timeline.h"
+
+#define TimelineChunk   4096            // spans per buffer
+
+struct span {
+    const char* name;
+    const char* category;
+    const char* argName;
+    long        arg;
+    uint64_t    start;
+    uint64_t    duration;
+};
+
+// a run of one thread's spans. Only that thread writes to it; count is stored
+// with release so the spans before it can be read from another thread
+struct buffer {
+    struct buffer*  next;               // in the list of all buffers
+    int             thread;
+    const char*     threadName;
+    int             count;
+    struct span     span[TimelineChunk];
+};
+
+int timing = false;
+
+static const char* timelinePath = NULL;
+static uint64_t origin;
+static struct buffer* buffers = NULL;   // every thread's buffers, newest first
+static int threads = 0;
+
+static __thread struct buffer* mine = NULL;
+static __thread int myThread = 0;       // 0 until the thread records a span
+
+
+uint64_t tlnow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+void tlopen(const char* path) {
+    timelinePath = path;
+    origin = tlnow();
+    timing = true;
+    tlthread("main");
+    atexit(tlclose);
+}
+
+//! A new buffer for the calling thread, added to the list without a lock.
+//
+static struct buffer* tlbuffer() {
+    struct buffer* b = malloc(sizeof(struct buffer));
+    if (b == NULL) {
+        return NULL;
+    }
+    if (myThread == 0) {
+        myThread = __atomic_add_fetch(&threads, 1, __ATOMIC_RELAXED);
+    }
+    b->thread = myThread;
+    b->threadName = (mine != NULL) ? mine->threadName : NULL;
+    b->count = 0;
+
+    b->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&buffers, &b->next, b, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // b->next has been reloaded, try again
+    }
+    mine = b;
+    return b;
+}
+
+void tlthread(const char* name) {
+    if (!timing) {
+        return;
+    }
+    if (mine == NULL && tlbuffer() == NULL) {
+        return;
+    }
+    mine->threadName = name;
+}
+
+void tlspan(const char* name, const char* category, uint64_t start, const char* argName, long arg) {
+    if (!timing) {
+        return;
+    }
+    uint64_t end = tlnow();
+
+    struct buffer* b = mine;
+    if (b == NULL || b->count == TimelineChunk) {
+        if ((b = tlbuffer()) == NULL) {
+            return;     // out of memory, the timeline goes short
+        }
+    }
+
+    struct span* s = &b->span[b->count];
+    s->name = name;
+    s->category = category;
+    s->argName = argName;
+    s->arg = arg;
+    s->start = start;
+    s->duration = (end > start) ? end - start : 0;
+    __atomic_store_n(&b->count, b->count + 1, __ATOMIC_RELEASE);
+}
+
+//! Stop recording and write the spans as a Trace Event Format JSON object. Also
+//! called at exit, so a run that fails still leaves its timeline.
+//
+void tlclose() {
+    if (timelinePath == NULL) {
+        return;
+    }
+    timing = false;
+
+    FILE* f = fopen(timelinePath, "w");
+    timelinePath = NULL;
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: unable to write the timeline\n");
+        return;
+    }
+
+    int pid = getpid();
+    const char* comma = "";
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (struct buffer* b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b != NULL; b = b->next) {
+        if (b->threadName != NULL) {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    comma, pid, b->thread, b->threadName);
+            comma = ",\n";
+        }
+
+        int count = __atomic_load_n(&b->count, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < count; i++) {
+            const struct span* s = &b->span[i];
+            long long ts = (s->start > origin) ? (long long) (s->start - origin) : 0;
+
+            fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%llu,\"pid\":%d,\"tid\":%d",
+                    comma, s->name, s->category, ts, (unsigned long long) s->duration, pid, b->thread);
+            if (s->argName != NULL) {
+                fprintf(f, ",\"args\":{\"%s\":%ld}", s->argName, s->arg);
+            }
+            fprintf(f, "}");
+            comma = ",\n";
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+}
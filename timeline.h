@@ -0,0 +1,41 @@
+/*
+ * File:   timeline.h
+ *
+ * A timeline of where a run's time went (--trace out.json): spans for opening
+ * the device, usb transfers, header reads, record decoding and output flushes,
+ * written as Chrome Trace Event Format JSON when the run ends.
+ */
+
+// V0.1
+
+#ifndef _TIMELINE_H
+#define	_TIMELINE_H
+
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // start recording spans, written to the file by tlclose() (or at exit)
+    void tlopen(const char* path);
+    void tlclose();
+
+    // true while recording, so callers can skip reading the clock
+    extern int timing;
+
+    // microseconds on the timeline clock
+    uint64_t tlnow();
+
+    // name the calling thread on the timeline
+    void tlthread(const char* name);
+
+    // a span from start to now. name, category and argName must be string
+    // constants, argName NULL for a span without an argument
+    void tlspan(const char* name, const char* category, uint64_t start, const char* argName, long arg);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _TIMELINE_H */
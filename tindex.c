@@ -0,0 +1,163 @@
+/*
+ *! tindex.c
+ *!
+ *! Record times are only known relative to the device time: each record holds
+ *! the minutes since the one before it (its interval byte). This keeps the
+ *! running total of those intervals from record 0 back, so the time of any
+ *! record is a lookup and the record for a time is a binary search.
+ *!
+ *! Only interval bytes are read, a stretch of records at a time, and only as
+ *! far back as has been asked for (doubling the stretch each time), so a short
+ *! listing from the device doesn't pull in the whole ring. The index follows
+ *! the header: if the current record moves it is built again.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "header.h"
+#include "wrecord.h"
+#include "dfile.h"
+#include "outbuf.h"
+#include "tindex.h"
+
+#define IndexStretch    16              // records read at first, doubled after
+
+static long* prefix = NULL;             // prefix[i] = sum of intervals of records 0..i-1
+static int records = 0;                 // records stored when the index was started
+static int built = 0;                   // prefix[0..built] are valid
+static long current = -1;               // location of record 0 when the index was started
+
+
+//! Start again if the header has moved on since the index was begun.
+//
+static void tcheck() {
+    if (prefix != NULL && current == getLocationOfCurrent() && records == getRecordsStored()) {
+        return;
+    }
+
+    free(prefix);
+    records = getRecordsStored();
+    current = getLocationOfCurrent();
+    prefix = malloc((records + 1) * sizeof(long));
+    if (prefix == NULL) {
+        printf("ERROR: unable to allocate the timestamp index, aborting...\n");
+        exit(1);
+    }
+    prefix[0] = 0;
+    built = 0;
+}
+
+//! Add the intervals of the n records from index first, which lie in one stretch
+//! of memory ending at location top (the record at index first).
+//
+static void tstretch(int first, long top, int n) {
+    long location = top - (n - 1) * RecordSize;
+    char buffer[IndexStretch * RecordSize];
+    char* copy = NULL;
+
+    const char* raw = dpointer(location, n * RecordSize);
+    if (raw == NULL) {
+        copy = (n <= IndexStretch) ? buffer : malloc(n * RecordSize);
+        if (copy == NULL) {
+            oflush();
+            printf("ERROR: unable to allocate the timestamp index, aborting...\n");
+            exit(1);
+        }
+        dread(copy, location, n * RecordSize);
+        raw = copy;
+    }
+
+    // higher indices lie at lower addresses
+    for (int i = 0; i < n; i++) {
+        prefix[first + i + 1] = prefix[first + i] + (raw[(n - 1 - i) * RecordSize] & 0xFF);
+    }
+
+    if (copy != buffer) {
+        free(copy);
+    }
+}
+
+//! Make sure prefix[0..index] are valid, reading the next stretch of records
+//! (at least as many as have been read so far) as often as needed.
+//
+static void textend(int index) {
+    while (built < index) {
+        int n = (built < IndexStretch) ? IndexStretch : built;
+        if (n > records - built) {
+            n = records - built;
+        }
+
+        // down to BaseAddress, then wrap round to the top (see dataaddress())
+        long top = dataaddress(built);
+        int run = (top - BaseAddress) / RecordSize + 1;
+        if (run > n) {
+            run = n;
+        }
+        tstretch(built, top, run);
+        if (n > run) {
+            tstretch(built + run, DeviceMemorySize - RecordSize, n - run);
+        }
+        built += n;
+    }
+}
+
+long tminutes(int index) {
+    tcheck();
+    if (index < 0 || index > records) {
+        return -1;
+    }
+    textend(index);
+    return prefix[index];
+}
+
+int tsearch(long minutes) {
+    tcheck();
+
+    // extend until the index reaches back far enough, or runs out
+    while (prefix[built] < minutes && built < records) {
+        textend(built + 1);
+    }
+    if (prefix[built] < minutes) {
+        return records + 1;
+    }
+
+    // the totals never decrease, so binary search for the first one that's enough
+    int low = 0;
+    int high = built;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (prefix[middle] < minutes) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void tinvalidate() {
+    free(prefix);
+    prefix = NULL;
+}
@@ -0,0 +1,31 @@
+/*
+ * File:   tindex.h
+ *
+ * Timestamp index of the stored records, built from their interval bytes.
+ */
+
+// V0.1
+
+#ifndef _TINDEX_H
+#define	_TINDEX_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // minutes from record 0 back to record index, the sum of the intervals of
+    // records 0..index-1 (index may be getRecordsStored()), -1 if out of range
+    long tminutes(int index);
+
+    // the lowest index (0..getRecordsStored()) with tminutes(index) >= minutes,
+    // getRecordsStored() + 1 if the records don't go back that far
+    int tsearch(long minutes);
+
+    // forget the index, it is rebuilt when next used
+    void tinvalidate();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _TINDEX_H */
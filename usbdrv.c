@@ -2,11 +2,19 @@
 //! usbdrv.c
 //! USB driver interaction
 //!
-//! V0.1
+//! Uses the libusb-1.0 asynchronous interface. Block reads are made from a pool
+//! of preallocated transfers that are completed by an event thread, each block
+//! being handed to the caller (normally chstream) as its reply arrives. Up to
+//! TransferDepth (config.h) reads are kept in flight so that the read command
+//! for one block goes out while the reply to the previous one is still awaited.
+//!
+//! V0.2
 //!
 //! Based on code (C) M. Pendec 2007
 //!
 //! (C) J. Whurr 2010
+//!
+//! Build with -DNO_USB for a wsrdr without libusb-1.0 (only -F then works).
 
 /*
     This file is part of the wsrdr programme.
@@ -30,22 +38,74 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <signal.h>
-#include <ctype.h>
-#include <usb.h>
+#include <pthread.h>
 
 #include "config.h"
+#include "usbdrv.h"
+#include "usbtrace.h"
+#include "outbuf.h"
+#include "timeline.h"
+
+// see usbstats()
+static struct usbStats statistics;
+
+//! The counts of the transfers made (none without libusb-1.0).
+//
+const struct usbStats* usbstats() {
+    return &statistics;
+}
+
+#ifndef NO_USB
+
+#include <libusb.h>
+
+#define	VendorId            0x1941
+#define	ProductId           0x8021
+#define	ReadEndpoint        0x81            // interrupt endpoint the device replies on
+#define	UsbTimeout          1000            // per transfer, in ms
+#define	UsbRetries          2               // times a timed out block read is re-sent
+
+#define	CommandType         (LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_OUT)
 
 
 // Data
-struct usb_dev_handle *devh;
-char   usbmsg[1000];
-char   buf[1000];
+static libusb_context *ctx = NULL;
+libusb_device_handle *devh = NULL;
+
+// a block read in flight: the 8 byte read command and the interrupt read of the reply
+struct BLOCKREAD {
+    struct libusb_transfer* command;
+    struct libusb_transfer* reply;
+    unsigned char setup[LIBUSB_CONTROL_SETUP_SIZE + 8];
+    unsigned char data[ReadBufferSize];
+    long location;
+    int retries;
+    uint64_t sent;              // when the command went, on the trace clock (usbtrace.h)
+};
+
+static struct BLOCKREAD pool[TransferDepth];
+
+// the batch being worked through by readBlocksFromUSB(), guarded by batchlock
+static struct {
+    const long* locations;
+    int count;
+    int next;                   // next location to request
+    int inflight;               // slots with a command or reply outstanding
+    int complete;               // blocks read in full
+    int failed;                 // a read command was not accepted...
+    int sent;                   // ...and how much of it went
+    usbBlockHandler handler;
+    void* context;
+} batch;
+
+static pthread_mutex_t batchlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batchidle = PTHREAD_COND_INITIALIZER;
+
+static pthread_t eventthread;
+static volatile int eventsrunning = 0;
 
-#if __DARWIN_UNIX03
-    #warning "defines replace library calls - need to change"
-    #define usb_get_driver_np(d, z, b, l)           (0)
-    #define usb_detach_kernel_driver_np(devh, z)    (0)
-#endif
+// set by SIGTERM, see terminate()
+static volatile sig_atomic_t terminated = 0;
 
 
 // Functions to use USB port and access device's memory
@@ -57,99 +117,162 @@ char   buf[1000];
 // - Read USB Message
 
 
-struct usb_device *find_device(int vendor, int product) {
-    struct usb_bus *bus;
+struct libusb_device *find_device(int vendor, int product) {
+    libusb_device **list;
+    libusb_device *found = NULL;
 
-    for (bus = usb_get_busses(); bus; bus = bus->next) {
-        struct usb_device *dev;
+    ssize_t count = libusb_get_device_list(ctx, &list);
+    for (ssize_t i = 0; i < count && found == NULL; i++) {
+        struct libusb_device_descriptor descriptor;
 
-        for (dev = bus->devices; dev; dev = dev->next) {
-            if (dev->descriptor.idVendor == vendor
-				&& dev->descriptor.idProduct == product)
-                return dev;
-        }
+        if (libusb_get_device_descriptor(list[i], &descriptor) == 0
+                && descriptor.idVendor == vendor
+                && descriptor.idProduct == product)
+            found = libusb_ref_device(list[i]);
     }
-    return NULL;
+    if (count >= 0)
+        libusb_free_device_list(list, 1);
+    return found;
 };
 
 void _close_readw() {
-    int ret = usb_release_interface(devh, 0);
+    if (devh == NULL)
+        return;
+
+    if (tracing)
+        tracerecord(TraceClose, 0, 0, 0, 0, NULL, 0);
+
+    int started = eventsrunning;
+    eventsrunning = 0;
+    int ret = libusb_release_interface(devh, 0);
     if (ret!=0)
         printf("could not release interface: %d\n", ret);
-    ret = usb_close(devh);
-    if (ret!=0)
-        printf("Error closing interface: %d\n", ret);
+
+    // closing the handle also wakes the event thread
+    libusb_close(devh);
+    devh = NULL;
+    if (started) {
+        pthread_join(eventthread, NULL);
+    }
+
+    for(int i = 0; i < TransferDepth; i++) {
+        libusb_free_transfer(pool[i].command);
+        libusb_free_transfer(pool[i].reply);
+        pool[i].command = pool[i].reply = NULL;
+    }
+    libusb_exit(ctx);
+    ctx = NULL;
 };
 
+//! SIGTERM only notes that it came: closing the device from the handler would
+//! join the event thread and call into libusb, neither of which can be done
+//! there. No more block reads are started, and once those in flight are in
+//! readBlocksFromUSB() closes the device and exits.
+//
+static void terminate(int sig) {
+    terminated = 1;
+}
+
 void _open_readw() {
-    struct usb_device *dev;
+    struct libusb_device *dev;
     int vendor, product, ret;
 
-#if 0	// ** DEBUG
-	usb_urb *isourb;
-	struct timeval isotv;
-	char isobuf[32768];
-#endif	// **
-
-    usb_init();
-    // usb_set_debug(0);
-    usb_find_busses();
-    usb_find_devices();
+    ret = libusb_init(&ctx);
+    if (ret != 0) {
+        printf("Could not initialise libusb, errorcode - %d\n", ret);
+        exit(1);
+    }
 
-    vendor = 0x1941;
-    product = 0x8021;
+    vendor = VendorId;
+    product = ProductId;
 
     dev = find_device(vendor, product);
     assert(dev);
-    devh = usb_open(dev);
-    assert(devh);
-    signal(SIGTERM, _close_readw);
-
-    ret = usb_get_driver_np(devh, 0, buf, sizeof(buf));
-    if (ret == 0) {
-        /* interface 0 already claimed by driver buf, attempting to detach it */
-        ret = usb_detach_kernel_driver_np(devh, 0);
-        /* usb_detach_kernel_driver_np returned ret */
+    ret = libusb_open(dev, &devh);
+    libusb_unref_device(dev);
+    assert(ret == 0);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = terminate;
+    sigaction(SIGTERM, &action, NULL);
+
+    if (libusb_kernel_driver_active(devh, 0) == 1) {
+        /* interface 0 already claimed by a kernel driver, attempting to detach it */
+        ret = libusb_detach_kernel_driver(devh, 0);
     }
 
-    ret = usb_claim_interface(devh, 0);
+    ret = libusb_claim_interface(devh, 0);
     if (ret != 0) {
         printf("Could not open usb device, errorcode - %d\n", ret);
         exit(1);
     }
 
-    ret = usb_set_altinterface(devh, 0);
+    ret = libusb_set_interface_alt_setting(devh, 0, 0);
     assert(ret >= 0);
+
+    for(int i = 0; i < TransferDepth; i++) {
+        pool[i].command = libusb_alloc_transfer(0);
+        pool[i].reply = libusb_alloc_transfer(0);
+        assert(pool[i].command && pool[i].reply);
+    }
+}
+
+//! libusb_get_descriptor(), recorded when tracing.
+//
+static int getDescriptor(uint8_t type, uint8_t index, unsigned char* data, int length) {
+    int ret = libusb_get_descriptor(devh, type, index, data, length);
+    if (tracing)
+        tracerecord(TraceDescriptor, 0, (type << 8) | index, ret, 0, data, ret);
+    return ret;
 }
 
 void _init_wread() {
-    char tbuf[1000];
+    unsigned char tbuf[1000];
+    uint64_t started = tracenow();
+    uint64_t spanned = timing ? tlnow() : 0;
 
-    int ret = usb_get_descriptor(devh, 1, 0, tbuf, 0x12);
+    int ret = getDescriptor(1, 0, tbuf, 0x12);
     // usleep(14*1000);
-    ret = usb_get_descriptor(devh, 2, 0, tbuf, 9);
-    // usleep(10*1000);((c = getopt (argc, argv, "akwosiurthp:zx")) != -1)
-    ret = usb_get_descriptor(devh, 2, 0, tbuf, 0x22);
+    ret = getDescriptor(2, 0, tbuf, 9);
+    // usleep(10*1000);
+    ret = getDescriptor(2, 0, tbuf, 0x22);
     // usleep(22*1000);
-    ret = usb_release_interface(devh, 0);
+    ret = libusb_release_interface(devh, 0);
     if (ret != 0) printf("failed to release interface before set_configuration: %d\n", ret);
-    ret = usb_set_configuration(devh, 1);
-    ret = usb_claim_interface(devh, 0);
+    ret = libusb_set_configuration(devh, 1);
+    ret = libusb_claim_interface(devh, 0);
     if (ret != 0) printf("claim after set_configuration failed with error %d\n", ret);
-    ret = usb_set_altinterface(devh, 0);
+    ret = libusb_set_interface_alt_setting(devh, 0, 0);
     // usleep(22*1000);
-    ret = usb_control_msg(devh, USB_TYPE_CLASS + USB_RECIP_INTERFACE, 0xa, 0, 0, tbuf, 0, 1000);
+    ret = libusb_control_transfer(devh, LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE, 0xa, 0, 0, tbuf, 0, UsbTimeout);
+    if (tracing)
+        tracerecord(TraceControl, 0, 0, ret, 0, NULL, 0);
     // usleep(4*1000);
-    ret = usb_get_descriptor(devh, 0x22, 0, tbuf, 0x74);
+    ret = getDescriptor(0x22, 0, tbuf, 0x74);
+
+    statistics.initMicros = tracenow() - started;
+    tlspan("_init_wread", "usb", spanned, NULL, 0);
 }
 
 int _read_usb_msg(char *buffer) {
-    char tbuf[ReadBufferSize];
+    int bytes = 0;
 
-    int bytes = usb_interrupt_read(devh, 0x81, tbuf, ReadBufferSize, 1000);
-    memcpy(buffer, tbuf, bytes);
-    // usleep(82*1000);flushDeviceMemory
-    return bytes;
+    int ret = libusb_interrupt_transfer(devh, ReadEndpoint, (unsigned char*) buffer, ReadBufferSize, &bytes, UsbTimeout);
+    if (tracing)
+        tracerecord(TraceInterrupt, 0, -1, (ret == 0) ? bytes : ret, 0, buffer, bytes);
+    return (ret == 0) ? bytes : ret;
+}
+
+//! Completes transfers for as long as the device is open.
+//
+static void* handleEvents(void* unused) {
+    tlthread("usb events");
+    while(eventsrunning) {
+        struct timeval timeout = { 0, 100000 };
+        libusb_handle_events_timeout_completed(ctx, &timeout, NULL);
+    }
+    return NULL;
 }
 
 void openUSBDevice() {
@@ -164,11 +287,22 @@ void openUSBDevice() {
     _open_readw();
     _init_wread();
 
+    eventsrunning = 1;
+    if (pthread_create(&eventthread, NULL, handleEvents, NULL) != 0) {
+        printf("Error: could not start the usb event thread, aborting...\n");
+        exit(1);
+    }
+
+    if (tracing)
+        tracerecord(TraceOpen, 0, 0, 0, 0, NULL, 0);
 }
 
 void _send_usb_msg(char* bytes ) {
-    int ret = usb_control_msg(devh, USB_TYPE_CLASS + USB_RECIP_INTERFACE, 9, 0x200, 0, bytes, 8, 1000);
+    int ret = libusb_control_transfer(devh, CommandType, 9, 0x200, 0, (unsigned char*) bytes, 8, UsbTimeout);
+    if (tracing)
+        tracerecord(TraceControl, 0, ((bytes[1] & 0xFF) << 8) | (bytes[2] & 0xFF), ret, 0, bytes, 8);
     if (ret != 8) {
+        oflush();
         printf("Error: usb_control_msg read %d characters, expecting 8, aborting...\n", ret);
         exit(1);
     }
@@ -176,22 +310,226 @@ void _send_usb_msg(char* bytes ) {
     // usleep(28*1000);
 }
 
+static void LIBUSB_CALL commandSent(struct libusb_transfer* transfer);
+static void LIBUSB_CALL replyReceived(struct libusb_transfer* transfer);
+
+//! Sends the read command for the slot's location. The interrupt read of the
+//! reply is posted once the command has gone. Called with batchlock held.
+//
+static int sendReadCommand(struct BLOCKREAD* slot) {
+    unsigned char addr1 = (unsigned char) ((slot->location >> 8) & 0xFF);
+    unsigned char addr2 = (unsigned char) (slot->location & 0xFF);
+    unsigned char buffersize = ReadBufferSize & 0xFF;
+    unsigned char* bytes = slot->setup + LIBUSB_CONTROL_SETUP_SIZE;
+
+    // set up to read 32 bytes starting at device memory 'location'
+    bytes[0] = 0xa1; bytes[1] = addr1; bytes[2] = addr2; bytes[3] = buffersize;
+    bytes[4] = 0xa1; bytes[5] = addr1; bytes[6] = addr2; bytes[7] = buffersize;
+
+    libusb_fill_control_setup(slot->setup, CommandType, 9, 0x200, 0, 8);
+    libusb_fill_control_transfer(slot->command, devh, slot->setup, commandSent, slot, UsbTimeout);
+    slot->sent = tracenow();
+    if (tracing)
+        tracerecord(TraceControl, 0, slot->location, 8, 0, bytes, 8);
+    return libusb_submit_transfer(slot->command);
+}
+
+//! Starts the next location of the batch on the given slot, if there is one.
+//! Called with batchlock held.
+//
+static void startBlockRead(struct BLOCKREAD* slot) {
+    if (batch.failed || terminated || batch.next >= batch.count) {
+        return;
+    }
+
+    slot->location = batch.locations[batch.next++];
+    slot->retries = 0;
+    if (sendReadCommand(slot) != 0) {
+        batch.failed = 1;
+        return;
+    }
+    batch.inflight++;
+}
+
+//! Finishes with a slot, reusing it for the next block. Called with batchlock held.
+//
+static void endBlockRead(struct BLOCKREAD* slot) {
+    batch.inflight--;
+    startBlockRead(slot);
+    if (batch.inflight == 0) {
+        pthread_cond_signal(&batchidle);
+    }
+}
+
+static void LIBUSB_CALL commandSent(struct libusb_transfer* transfer) {
+    struct BLOCKREAD* slot = transfer->user_data;
+
+    pthread_mutex_lock(&batchlock);
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED || transfer->actual_length != 8) {
+        batch.failed = 1;
+        batch.sent = transfer->actual_length;
+        endBlockRead(slot);
+    }
+    else {
+        libusb_fill_interrupt_transfer(slot->reply, devh, ReadEndpoint, slot->data, ReadBufferSize, replyReceived, slot, UsbTimeout);
+        if (libusb_submit_transfer(slot->reply) != 0) {
+            batch.failed = 1;
+            endBlockRead(slot);
+        }
+    }
+    pthread_mutex_unlock(&batchlock);
+}
+
+//! Count a reply (bytes delivered, or -1 for a failed read, or 0 and timedout for
+//! one that will be asked for again) and the time it took since its read command.
+//! Only the event thread calls this.
+//
+static void countReply(struct BLOCKREAD* slot, int bytes, int timedout) {
+    long long latency = tracenow() - slot->sent;
+    int bucket = 0;
+    while (bucket < UsbLatencyBuckets - 1 && latency >= UsbLatencyBucket(bucket)) {
+        bucket++;
+    }
+
+    statistics.transfers++;
+    statistics.latency[bucket]++;
+    statistics.latencyTotal += latency;
+    if (latency > statistics.latencyMax) {
+        statistics.latencyMax = latency;
+    }
+    if (timing) {
+        tlspan(timedout ? "timed out" : "transfer", "usb", tlnow() - latency, "location", slot->location);
+    }
+    if (timedout) {
+        statistics.retries++;
+    }
+    else if (bytes < 0) {
+        statistics.failures++;
+    }
+    else {
+        statistics.bytes += bytes;
+        if (bytes < ReadBufferSize) {
+            statistics.shortReads++;
+        }
+    }
+}
+
+static void LIBUSB_CALL replyReceived(struct libusb_transfer* transfer) {
+    struct BLOCKREAD* slot = transfer->user_data;
+
+    pthread_mutex_lock(&batchlock);
+    if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT && slot->retries < UsbRetries && !batch.failed) {
+        // ask again rather than fail the block outright
+        if (tracing)
+            tracerecord(TraceInterrupt, TraceRetried, slot->location, LIBUSB_ERROR_TIMEOUT, slot->sent, NULL, 0);
+        countReply(slot, 0, true);
+        slot->retries++;
+        if (sendReadCommand(slot) == 0) {
+            pthread_mutex_unlock(&batchlock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&batchlock);
+
+    // deliver the block, a failed read is reported as a negative size as the
+    // synchronous interface did
+    int bytes = (transfer->status == LIBUSB_TRANSFER_COMPLETED) ? transfer->actual_length : -1;
+    if (tracing)
+        tracerecord(TraceInterrupt, 0, slot->location, bytes, slot->sent, slot->data, bytes);
+    countReply(slot, bytes, false);
+    batch.handler(batch.context, slot->location, (char*) slot->data, bytes);
+
+    pthread_mutex_lock(&batchlock);
+    if (bytes == ReadBufferSize) {
+        batch.complete++;
+    }
+    endBlockRead(slot);
+    pthread_mutex_unlock(&batchlock);
+}
+
+//! Reads a batch of ReadBufferSize blocks, handing each one to the handler (on the
+//! event thread) as it arrives. Returns once every block has been delivered with
+//! the number that were read in full.
+//
+int readBlocksFromUSB(const long* locations, int count, usbBlockHandler handler, void* context) {
+    pthread_mutex_lock(&batchlock);
+
+    batch.locations = locations;
+    batch.count = count;
+    batch.next = 0;
+    batch.inflight = 0;
+    batch.complete = 0;
+    batch.failed = 0;
+    batch.sent = 0;
+    batch.handler = handler;
+    batch.context = context;
+
+    for(int i = 0; i < TransferDepth; i++) {
+        startBlockRead(&pool[i]);
+    }
+    while(batch.inflight > 0) {
+        pthread_cond_wait(&batchidle, &batchlock);
+    }
+
+    int complete = batch.complete;
+    int failed = batch.failed;
+    int sent = batch.sent;
+    pthread_mutex_unlock(&batchlock);
+
+    if (failed) {
+        oflush();
+        printf("Error: usb_control_msg read %d characters, expecting 8, aborting...\n", sent);
+        exit(1);
+    }
+    if (terminated) {
+        _close_readw();
+        exit(1);
+    }
+    return complete;
+}
+
+// where readBytesFromUSB() wants its block
+struct BLOCKCOPY {
+    char* buffer;
+    int bytes;
+};
+
+static void copyBlock(void* context, long location, char* data, int bytes) {
+    struct BLOCKCOPY* copy = context;
+
+    if (bytes > 0) {
+        memcpy(copy->buffer, data, bytes);
+    }
+    copy->bytes = bytes;
+}
+
 int readBytesFromUSB(char* buffer, long location) {
+    struct BLOCKCOPY copy = { buffer, -1 };
 
-    unsigned char addr1 = (unsigned char) ((location >> 8) & 0xFF);
-    unsigned char addr2 = (unsigned char) (location & 0xFF);
+    readBlocksFromUSB(&location, 1, copyBlock, &copy);
+    return copy.bytes;
+}
 
-    char buffersize = ReadBufferSize & 0xFF;
-    char bytes[] = {'\xa1', addr1, addr2, buffersize, '\xa1', addr1, addr2, buffersize};
+const struct usbBackend usbDevice = { openUSBDevice, readBytesFromUSB, readBlocksFromUSB, _close_readw };
 
-    // set up to read 32 bytes starting at device memory 'location'
-    _send_usb_msg(bytes);
+#else // NO_USB
 
-    // read the bytes into the buffer
-    return _read_usb_msg(buffer);
+static void noUSBDevice() {
+    printf("ERROR: this wsrdr was built without libusb-1.0, read from a file with -F\n");
+    exit(1);
 }
 
+static int noBytes(char* buffer, long location) {
+    return -1;
+}
 
+static int noBlocks(const long* locations, int count, usbBlockHandler handler, void* context) {
+    return 0;
+}
 
+static void noClose() {
+}
 
+const struct usbBackend usbDevice = { noUSBDevice, noBytes, noBlocks, noClose };
 
+#endif // NO_USB
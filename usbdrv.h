@@ -14,15 +14,49 @@
 extern "C" {
 #endif
 
-struct usb_device *find_device(int vendor, int product);
+struct libusb_device *find_device(int vendor, int product);
 void _close_readw();
 void _open_readw();
 void _init_wread();
 void _send_usb_msg(char* bytes);
 int _read_usb_msg(char *buffer);
 
+// receives each block of a readBlocksFromUSB() batch as it arrives
+typedef void (*usbBlockHandler)(void* context, long location, char* data, int bytes);
+
 void openUSBDevice();
 int readBytesFromUSB(char* buffer, long location);
+int readBlocksFromUSB(const long* locations, int count, usbBlockHandler handler, void* context);
+
+// where chstream gets its blocks from: the device, or a stand-in for it (simdev.h)
+struct usbBackend {
+    void    (*open)();
+    int     (*readBytes)(char* buffer, long location);
+    int     (*readBlocks)(const long* locations, int count, usbBlockHandler handler, void* context);
+    void    (*close)();
+};
+
+extern const struct usbBackend usbDevice;
+
+// reply latencies are counted in buckets doubling from 64us, the last holding
+// everything longer (see usbstats())
+#define UsbLatencyBuckets   16
+#define UsbLatencyBucket(i) (64L << (i))
+
+// what the device has been asked for, for --stats
+struct usbStats {
+    long        transfers;          // block reads, each reply (or timeout) counted
+    long long   bytes;              // bytes the replies delivered
+    long        retries;            // timed out reads asked for again
+    long        shortReads;         // replies of less than a block
+    long        failures;           // reads that failed outright
+    long long   initMicros;         // time _init_wread() took
+    long long   latencyTotal;       // microseconds from read command to reply
+    long long   latencyMax;
+    long        latency[UsbLatencyBuckets];
+};
+
+const struct usbStats* usbstats();
 
 
 #ifdef	__cplusplus
@@ -0,0 +1,314 @@
+/*
+ *! usbtrace.c
+ *!
+ *! Field problems with a station (slow reads, stalls, corrupted blocks) are
+ *! hard to look at away from it. With -T file every usb transaction of a run is
+ *! recorded: the descriptor reads of _init_wread(), each control message (the
+ *! 8 byte read commands) and each interrupt read with the data that came back,
+ *! all timestamped. The trace is binary, TraceMagic then a struct traceEntry
+ *! and its payload per transaction (host byte order, little endian on the hosts
+ *! wsrdr runs on).
+ *!
+ *! :replay:trace[,speed=n][,report=1] plays a trace back as the device, through
+ *! the same interface chstream reads the device with (struct usbBackend). Each
+ *! block asked for is answered with the next reply recorded for it, with its
+ *! data as it was (short or corrupt) and after as long as it took (divided by
+ *! speed, 0 for no waiting). A read that timed out and was asked for again
+ *! costs its time too. A run that reads in the same order as the one recorded
+ *! takes the replies in turn; out of order they are searched for, and blocks
+ *! that were never recorded come from the last data seen for them, if any.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "usbdrv.h"
+#include "usbtrace.h"
+
+int tracing = false;
+
+static FILE* tracefile = NULL;
+static struct timespec origin;
+static pthread_mutex_t tracelock = PTHREAD_MUTEX_INITIALIZER;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   C A P T U R E
+//
+
+void traceopen(const char* path) {
+    if ((tracefile = fopen(path, "wb")) == NULL) {
+        printf("ERROR: unable to create trace file %s\n", path);
+        exit(1);
+    }
+    fwrite(TraceMagic, 1, 8, tracefile);
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+    tracing = true;
+}
+
+uint64_t tracenow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - origin.tv_sec) * 1000000LL + (now.tv_nsec - origin.tv_nsec) / 1000;
+}
+
+void tracerecord(int kind, int flags, long location, int result, uint64_t started, const void* payload, int length) {
+    struct traceEntry entry;
+
+    entry.micros = tracenow();
+    entry.elapsed = (started > 0 && started < entry.micros) ? entry.micros - started : 0;
+    entry.location = location;
+    entry.result = result;
+    entry.kind = kind;
+    entry.flags = flags;
+    entry.length = (payload != NULL && length > 0) ? length : 0;
+
+    pthread_mutex_lock(&tracelock);
+    if (tracefile != NULL) {
+        fwrite(&entry, sizeof(entry), 1, tracefile);
+        fwrite(payload, 1, entry.length, tracefile);
+    }
+    pthread_mutex_unlock(&tracelock);
+}
+
+void traceclose() {
+    pthread_mutex_lock(&tracelock);
+    tracing = false;
+    if (tracefile != NULL) {
+        fclose(tracefile);
+        tracefile = NULL;
+    }
+    pthread_mutex_unlock(&tracelock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+//   R E P L A Y
+//
+
+struct reply {
+    struct traceEntry entry;            // copied out, entries in the file aren't aligned
+    const unsigned char* data;
+    char used;
+};
+
+static char* trace = NULL;
+static struct reply* replies = NULL;    // the interrupt reads, in the order recorded
+static int nreplies = 0;
+static int replyroom = 0;
+static int cursor = 0;                  // replies before this have all been used
+static double speed = 1.0;
+static int report = false;
+
+// the last data seen for each block, for blocks read that weren't recorded
+static unsigned char image[DeviceMemorySize];
+static char seen[DeviceMemorySize / ReadBufferSize];
+
+static struct {
+    long        blocks;
+    long        inOrder;
+    long        reordered;
+    long        missing;
+    long long   waited;                 // microseconds of replayed transfer time
+} replayCounts;
+
+
+void replayconfigure(const char* spec) {
+    char path[1024];
+    size_t length = strcspn(spec, ",");
+    if (length >= sizeof(path)) {
+        printf("ERROR: trace file name too long\n");
+        exit(1);
+    }
+    memcpy(path, spec, length);
+    path[length] = '\0';
+
+    for (const char* p = spec + length; *p == ','; p += strcspn(p + 1, ",") + 1) {
+        if (sscanf(p + 1, "speed=%lf", &speed) == 1) {
+            continue;
+        }
+        if (sscanf(p + 1, "report=%d", &report) == 1) {
+            continue;
+        }
+        printf("ERROR: bad replay setting %s\n", p + 1);
+        exit(1);
+    }
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("ERROR: unable to open trace file %s\n", path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    trace = malloc(size > 0 ? size : 1);
+    if (trace == NULL || fread(trace, 1, size, f) != (size_t) size
+            || size < 8 || memcmp(trace, TraceMagic, 8) != 0) {
+        printf("ERROR: %s is not a wsrdr usb trace\n", path);
+        exit(1);
+    }
+    fclose(f);
+
+    // index the replies, and keep the last data of each block
+    long offset = 8;
+    while (offset + (long) sizeof(struct traceEntry) <= size) {
+        struct traceEntry entry;
+        memcpy(&entry, trace + offset, sizeof(entry));
+        const unsigned char* payload = (const unsigned char*) trace + offset + sizeof(entry);
+        offset += sizeof(entry) + entry.length;
+        if (offset > size) {
+            break;      // cut short while recording
+        }
+        if (entry.kind != TraceInterrupt) {
+            continue;
+        }
+
+        if (nreplies == replyroom) {
+            replyroom = replyroom ? 2 * replyroom : 64;
+            replies = realloc(replies, replyroom * sizeof(struct reply));
+            if (replies == NULL) {
+                printf("ERROR: unable to allocate the trace index, aborting...\n");
+                exit(1);
+            }
+        }
+        replies[nreplies].entry = entry;
+        replies[nreplies].data = payload;
+        replies[nreplies].used = false;
+        nreplies++;
+
+        if (entry.result == ReadBufferSize && entry.length == ReadBufferSize && entry.location < DeviceMemorySize) {
+            memcpy(image + entry.location, payload, ReadBufferSize);
+            seen[entry.location / ReadBufferSize] = true;
+        }
+    }
+}
+
+//! The next unused reply recorded for the location, -1 if there isn't one.
+//
+static int findReply(long location) {
+    for (int i = cursor; i < nreplies; i++) {
+        if (!replies[i].used && replies[i].entry.location == location) {
+            if (i == cursor) {
+                replayCounts.inOrder++;
+            }
+            else {
+                replayCounts.reordered++;
+            }
+            replies[i].used = true;
+            while (cursor < nreplies && replies[cursor].used) {
+                cursor++;
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+//! Wait as long as reply i took: the time since its command, or, when reads
+//! were overlapped, the time since the reply before it if that is less.
+//
+static void replayWait(int i) {
+    uint64_t wait = replies[i].entry.elapsed;
+    if (i > 0) {
+        uint64_t gap = replies[i].entry.micros - replies[i - 1].entry.micros;
+        if (gap < wait) {
+            wait = gap;
+        }
+    }
+    replayCounts.waited += wait;
+    if (speed > 0) {
+        usleep((useconds_t) (wait / speed));
+    }
+}
+
+//! Replay the read of one block, returning the bytes delivered (-1 for a failed
+//! read, as the driver reports them).
+//
+static int replayBlock(char* buffer, long location) {
+    replayCounts.blocks++;
+
+    for (;;) {
+        int i = findReply(location);
+        if (i < 0) {
+            replayCounts.missing++;
+            if (seen[location / ReadBufferSize]) {
+                memcpy(buffer, image + location, ReadBufferSize);
+                return ReadBufferSize;
+            }
+            return -1;
+        }
+
+        replayWait(i);
+        if (replies[i].entry.flags & TraceRetried) {
+            continue;   // the driver asked again, so take the next reply too
+        }
+
+        int bytes = replies[i].entry.result;
+        if (bytes > replies[i].entry.length) {
+            bytes = replies[i].entry.length;
+        }
+        if (bytes > 0) {
+            memcpy(buffer, replies[i].data, bytes);
+        }
+        return (replies[i].entry.result < 0) ? -1 : bytes;
+    }
+}
+
+static void replayopen() {
+    memset(&replayCounts, 0, sizeof(replayCounts));
+}
+
+static int replayreadbytes(char* buffer, long location) {
+    return replayBlock(buffer, location);
+}
+
+static int replayreadblocks(const long* locations, int count, usbBlockHandler handler, void* context) {
+    char data[ReadBufferSize];
+    int complete = 0;
+
+    for (int i = 0; i < count; i++) {
+        int bytes = replayBlock(data, locations[i]);
+        handler(context, locations[i], data, bytes);
+        if (bytes == ReadBufferSize) {
+            complete++;
+        }
+    }
+    return complete;
+}
+
+static void replayclose() {
+    if (report) {
+        fprintf(stderr, "replay: blocks=%ld inorder=%ld reordered=%ld missing=%ld waited=%lldus\n",
+                replayCounts.blocks, replayCounts.inOrder, replayCounts.reordered,
+                replayCounts.missing, replayCounts.waited);
+    }
+}
+
+const struct usbBackend replayDevice = { replayopen, replayreadbytes, replayreadblocks, replayclose };
@@ -0,0 +1,65 @@
+/*
+ * File:   usbtrace.h
+ *
+ * Records the usb transactions of a run to a trace file (-T file), and plays
+ * a trace back as the device (:replay:trace[,speed=n]).
+ */
+
+// V0.1
+
+#ifndef _USBTRACE_H
+#define	_USBTRACE_H
+
+#include <stdint.h>
+
+#include "usbdrv.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    #define TraceMagic      "WSRDRT01"
+
+    // the file is the magic then entries, each followed by length bytes of payload
+    struct traceEntry {
+        uint64_t    micros;             // since the trace was opened
+        uint32_t    elapsed;            // replies: microseconds since their read command
+        uint32_t    location;           // device address, or descriptor type << 8 | index
+        int32_t     result;             // bytes, or a negative libusb status
+        uint8_t     kind;               // one of the Trace... kinds below
+        uint8_t     flags;
+        uint16_t    length;
+    };
+
+    #define TraceOpen           1       // the device was opened
+    #define TraceDescriptor     2       // a descriptor read (_init_wread())
+    #define TraceControl        3       // a control message, the 8 byte command
+    #define TraceInterrupt      4       // an interrupt read, the data that came back
+    #define TraceClose          5
+
+    #define TraceRetried        0x01    // flags: the read timed out and was asked for again
+
+    // start recording to the file
+    void traceopen(const char* path);
+    void traceclose();
+
+    // true while recording, so callers can skip building entries
+    extern int tracing;
+
+    // microseconds on the trace clock
+    uint64_t tracenow();
+
+    // add an entry (thread safe, the usb event thread records replies)
+    void tracerecord(int kind, int flags, long location, int result, uint64_t started, const void* payload, int length);
+
+    // play back the trace in the spec after :replay:, exits if it can't
+    void replayconfigure(const char* spec);
+
+    // the replayed trace as chstream's block source (see ubackend())
+    extern const struct usbBackend replayDevice;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _USBTRACE_H */
@@ -0,0 +1,208 @@
+/*
+ *! utctime.c
+ *!
+ *! The device keeps its date & time in UTC, so record times are worked out and
+ *! printed in UTC, with plain calendar arithmetic (days_from_civil and its
+ *! inverse, after H. Hinnant) rather than mktime()/localtime() and the time zone
+ *! and daylight saving rules behind them.
+ *!
+ *! Listings step from one record's time to the next, and those mostly differ by
+ *! a few minutes, so utcUpdate() only rewrites the hour and minute digits of the
+ *! previous string unless the day has changed.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "utctime.h"
+
+#define SecondsPerDay   86400L
+
+static const char twoDigits[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+#define putTwo(p, v)    ((p)[0] = twoDigits[(v) * 2], (p)[1] = twoDigits[(v) * 2 + 1])
+
+
+//! Days since 1970-01-01 of the given date. Years are counted from March so the
+//! leap day comes at the end, and then in 400 year eras of 146097 days.
+//
+long daysFromCivil(int year, int month, int day) {
+    year -= (month <= 2);
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yoe = year - era * 400;                                        // [0, 399]
+    long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1; // [0, 365]
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                   // [0, 146096]
+    return era * 146097 + doe - 719468;
+}
+
+//! The date of a number of days since 1970-01-01, the inverse of daysFromCivil().
+//
+void civilFromDays(long days, int* year, int* month, int* day) {
+    days += 719468;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long doe = days - era * 146097;                                     // [0, 146096]
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;   // [0, 399]
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);                 // [0, 365]
+    long mp = (5 * doy + 2) / 153;                                      // [0, 11]
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp + (mp < 10 ? 3 : -9);
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+//! Read a number of up to digits digits, followed by the separator sep (if not
+//! '\0'). Returns the position after them, NULL if they are not there.
+//
+static const char* utcField(const char* p, int digits, char sep, int* value) {
+    int n = 0;
+
+    *value = 0;
+    while (n < digits && isdigit((unsigned char) *p)) {
+        *value = *value * 10 + (*p++ - '0');
+        n++;
+    }
+    if (n == 0) {
+        return NULL;
+    }
+    if (sep == ' ') {
+        if (!isspace((unsigned char) *p)) {
+            return NULL;
+        }
+        while (isspace((unsigned char) *p)) {
+            p++;
+        }
+    }
+    else if (sep != '\0') {
+        if (*p++ != sep) {
+            return NULL;
+        }
+    }
+    return p;
+}
+
+time_t utcParse(const char* date) {
+    int year, month, day, hour, minute;
+    const char* p = date;
+
+    while (isspace((unsigned char) *p)) {
+        p++;
+    }
+    if ((p = utcField(p, 4, '-', &year)) == NULL
+            || (p = utcField(p, 2, '-', &month)) == NULL
+            || (p = utcField(p, 2, ' ', &day)) == NULL
+            || (p = utcField(p, 2, ':', &hour)) == NULL
+            || (p = utcField(p, 2, '\0', &minute)) == NULL) {
+        return (time_t) -1;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59) {
+        return (time_t) -1;
+    }
+
+    return (time_t) daysFromCivil(year, month, day) * SecondsPerDay + hour * 3600 + minute * 60;
+}
+
+//! Write the date part ("YYYY-MM-DD ") of the given day.
+//
+static void utcDay(char* string, long days) {
+    int year, month, day;
+
+    civilFromDays(days, &year, &month, &day);
+    if (year < 0 || year > 9999) {
+        // not a date the device could have, but keep to the width
+        char wide[32];
+        snprintf(wide, sizeof(wide), "%04d-%02d-%02d ", year % 10000, month, day);
+        memcpy(string, wide, 11);
+        return;
+    }
+    putTwo(string, year / 100);
+    putTwo(string + 2, year % 100);
+    string[4] = '-';
+    putTwo(string + 5, month);
+    string[7] = '-';
+    putTwo(string + 8, day);
+    string[10] = ' ';
+}
+
+//! Write the time part ("HH:MM") of the given minute of the day.
+//
+static void utcMinute(char* string, int minute) {
+    putTwo(string, minute / 60);
+    string[2] = ':';
+    putTwo(string + 3, minute % 60);
+    string[5] = '\0';
+}
+
+//! Split a time into days since 1970-01-01 and the minute of that day (rounding
+//! down, before 1970 as well).
+//
+static void utcSplit(time_t time, long* day, int* minute) {
+    long seconds = time % SecondsPerDay;
+
+    *day = time / SecondsPerDay;
+    if (seconds < 0) {
+        seconds += SecondsPerDay;
+        (*day)--;
+    }
+    *minute = seconds / 60;
+}
+
+void utcFormat(char* string, time_t time) {
+    long day;
+    int minute;
+
+    utcSplit(time, &day, &minute);
+    utcDay(string, day);
+    utcMinute(string + 11, minute);
+}
+
+void utcClear(struct utcDate* date) {
+    memset(date, 0, sizeof(*date));
+    date->minute = -1;
+}
+
+const char* utcUpdate(struct utcDate* date, time_t time) {
+    long day;
+    int minute;
+
+    utcSplit(time, &day, &minute);
+    if (date->minute < 0 || day != date->day) {
+        utcDay(date->text, day);
+        date->day = day;
+        date->minute = -1;
+    }
+    if (minute != date->minute) {
+        utcMinute(date->text + 11, minute);
+        date->minute = minute;
+    }
+    return date->text;
+}
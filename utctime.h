@@ -0,0 +1,45 @@
+/*
+ * File:   utctime.h
+ *
+ * UTC date & time conversions, without the C library's time zone handling.
+ */
+
+// V0.1
+
+#ifndef _UTCTIME_H
+#define	_UTCTIME_H
+
+#include <time.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // a formatted date/time that is updated from one record's time to the next
+    struct utcDate {
+        long            day;            // days since 1970-01-01 of text
+        int             minute;         // minute of that day of text
+        char            text[17];       // "YYYY-MM-DD HH:MM"
+    };
+
+    // days since 1970-01-01 of a date on the (proleptic) Gregorian calendar,
+    // and back again
+    long daysFromCivil(int year, int month, int day);
+    void civilFromDays(long days, int* year, int* month, int* day);
+
+    // "YYYY-MM-DD HH:MM" (UTC) to a time_t, -1 if it isn't in that form
+    time_t utcParse(const char* date);
+
+    // a time_t as "YYYY-MM-DD HH:MM" (UTC), string must hold 17 characters
+    void utcFormat(char* string, time_t time);
+
+    // bring date->text up to the given time, rewriting only what has changed,
+    // and return it. utcClear() the date before its first update
+    void utcClear(struct utcDate* date);
+    const char* utcUpdate(struct utcDate* date, time_t time);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _UTCTIME_H */
@@ -0,0 +1,274 @@
+/*
+ *! wbatch.c
+ *!
+ *! Decodes runs of weather records a column at a time (struct weatherColumns in
+ *! wbatch.h) rather than a struct weatherRecord each. The raw records of a run are
+ *! got with one dread() (or straight from a mapped image) per stretch of memory,
+ *! and each field ends up in its own array, still in device units, ready for
+ *! aggregation and export over whole images. On x86 with SSSE3 the decode step
+ *! shuffles eight records at a time into the columns; elsewhere it falls back to
+ *! the plain loop.
+ *!
+ *! V0.1
+ */
+
+/*
+    This file is part of the wsrdr programme.
+
+    wsrdr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    wsrdr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with wsrdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "header.h"
+#include "wrecord.h"
+#include "wbatch.h"
+#include "dfile.h"
+#include "timeline.h"
+
+
+//! Allocate the column arrays (and raw scratch) for up to capacity records.
+//
+int allocColumns(struct weatherColumns* cols, int capacity) {
+    memset(cols, 0, sizeof(struct weatherColumns));
+
+    // the 16 bit columns first so that everything stays aligned
+    size_t size = capacity * (4 * sizeof(uint16_t) + 2 * sizeof(int16_t) + 6 * sizeof(uint8_t) + RecordSize);
+    char* block = malloc(size);
+    if (block == NULL) {
+        return false;
+    }
+
+    cols->memPos        = (uint16_t*) block;    block += capacity * sizeof(uint16_t);
+    cols->press         = (uint16_t*) block;    block += capacity * sizeof(uint16_t);
+    cols->gustSpeed     = (uint16_t*) block;    block += capacity * sizeof(uint16_t);
+    cols->rainCounter   = (uint16_t*) block;    block += capacity * sizeof(uint16_t);
+    cols->tempIn        = (int16_t*) block;     block += capacity * sizeof(int16_t);
+    cols->tempOut       = (int16_t*) block;     block += capacity * sizeof(int16_t);
+    cols->interval      = (uint8_t*) block;     block += capacity;
+    cols->humIn         = (uint8_t*) block;     block += capacity;
+    cols->humOut        = (uint8_t*) block;     block += capacity;
+    cols->windSpeed     = (uint8_t*) block;     block += capacity;
+    cols->windDir       = (uint8_t*) block;     block += capacity;
+    cols->errorCode     = (uint8_t*) block;     block += capacity;
+    cols->raw           = block;
+
+    cols->capacity = capacity;
+    return true;
+}
+
+void freeColumns(struct weatherColumns* cols) {
+    free(cols->memPos);
+    memset(cols, 0, sizeof(struct weatherColumns));
+}
+
+//! Decode n raw records, as laid out in device memory from location, into
+//! columns at..at+n-1. Field for field the same as rreadl() (see wrecord.c).
+//
+static void decodeColumnsScalar(struct weatherColumns* cols, int at, const char* raw, int n, long location) {
+    for(int i = 0; i < n; i++, raw += RecordSize) {
+        int k = at + i;
+        cols->memPos[k]         = location + i * RecordSize;
+        cols->interval[k]       = raw[0];
+        cols->humIn[k]          = raw[1];
+        cols->tempIn[k]         = getSignedInt((char*) raw + 0x02);
+        cols->humOut[k]         = raw[4];
+        cols->tempOut[k]        = getSignedInt((char*) raw + 0x05);
+        cols->press[k]          = getUnsignedInt((char*) raw + 0x07);
+        cols->windSpeed[k]      = raw[9];
+        cols->gustSpeed[k]      = getUnsignedInt((char*) raw + 0x0A);
+        cols->windDir[k]        = raw[12];
+        cols->rainCounter[k]    = getUnsignedInt((char*) raw + 0x0D);
+        cols->errorCode[k]      = raw[15];
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(NO_SIMD)
+
+#include <tmmintrin.h>
+
+#define	DecodeSSSE3
+
+// A record is one 16 byte register. shufflewords picks the two byte fields and
+// bytes of the eight 16 bit columns out of it (0x80 = zero), shufflebytes the
+// remaining byte fields.
+#define	Z   ((char) 0x80)
+
+// sign-magnitude (see getSignedInt()) to two's complement, eight at a time
+#define	signedWords(v)  _mm_sub_epi16(_mm_xor_si128(_mm_and_si128(v, _mm_set1_epi16(0x7FFF)), _mm_srai_epi16(v, 15)), _mm_srai_epi16(v, 15))
+
+__attribute__((target("ssse3")))
+static void decodeColumnsSSSE3(struct weatherColumns* cols, int at, const char* raw, int n, long location) {
+    // lanes: interval, humIn, tempIn, humOut, tempOut, press, gustSpeed, rainCounter
+    const __m128i shufflewords = _mm_setr_epi8(0, Z, 1, Z, 2, 3, 4, Z, 5, 6, 7, 8, 10, 11, 13, 14);
+    // lanes: windSpeed, windDir, errorCode
+    const __m128i shufflebytes = _mm_setr_epi8(9, Z, 12, Z, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z);
+    const __m128i step = _mm_setr_epi16(0, 1 * RecordSize, 2 * RecordSize, 3 * RecordSize, 4 * RecordSize, 5 * RecordSize, 6 * RecordSize, 7 * RecordSize);
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8, raw += 8 * RecordSize) {
+        __m128i w[8], b[8];
+        for(int r = 0; r < 8; r++) {
+            __m128i record = _mm_loadu_si128((const __m128i*) (raw + r * RecordSize));
+            w[r] = _mm_shuffle_epi8(record, shufflewords);
+            b[r] = _mm_shuffle_epi8(record, shufflebytes);
+        }
+
+        // 8x8 transpose of 16 bit lanes: record-per-register to column-per-register
+        __m128i t0 = _mm_unpacklo_epi16(w[0], w[1]), t1 = _mm_unpackhi_epi16(w[0], w[1]);
+        __m128i t2 = _mm_unpacklo_epi16(w[2], w[3]), t3 = _mm_unpackhi_epi16(w[2], w[3]);
+        __m128i t4 = _mm_unpacklo_epi16(w[4], w[5]), t5 = _mm_unpackhi_epi16(w[4], w[5]);
+        __m128i t6 = _mm_unpacklo_epi16(w[6], w[7]), t7 = _mm_unpackhi_epi16(w[6], w[7]);
+        __m128i u0 = _mm_unpacklo_epi32(t0, t2), u1 = _mm_unpackhi_epi32(t0, t2);
+        __m128i u2 = _mm_unpacklo_epi32(t1, t3), u3 = _mm_unpackhi_epi32(t1, t3);
+        __m128i u4 = _mm_unpacklo_epi32(t4, t6), u5 = _mm_unpackhi_epi32(t4, t6);
+        __m128i u6 = _mm_unpacklo_epi32(t5, t7), u7 = _mm_unpackhi_epi32(t5, t7);
+
+        __m128i interval  = _mm_unpacklo_epi64(u0, u4);
+        __m128i humIn     = _mm_unpackhi_epi64(u0, u4);
+        __m128i tempIn    = _mm_unpacklo_epi64(u1, u5);
+        __m128i humOut    = _mm_unpackhi_epi64(u1, u5);
+        __m128i tempOut   = _mm_unpacklo_epi64(u2, u6);
+        __m128i press     = _mm_unpackhi_epi64(u2, u6);
+        __m128i gustSpeed = _mm_unpacklo_epi64(u3, u7);
+        __m128i rain      = _mm_unpackhi_epi64(u3, u7);
+
+        // only the first three lanes of the byte fields are used
+        t0 = _mm_unpacklo_epi16(b[0], b[1]);
+        t2 = _mm_unpacklo_epi16(b[2], b[3]);
+        t4 = _mm_unpacklo_epi16(b[4], b[5]);
+        t6 = _mm_unpacklo_epi16(b[6], b[7]);
+        u0 = _mm_unpacklo_epi32(t0, t2), u1 = _mm_unpackhi_epi32(t0, t2);
+        u4 = _mm_unpacklo_epi32(t4, t6), u5 = _mm_unpackhi_epi32(t4, t6);
+
+        __m128i windSpeed = _mm_unpacklo_epi64(u0, u4);
+        __m128i windDir   = _mm_unpackhi_epi64(u0, u4);
+        __m128i errorCode = _mm_unpacklo_epi64(u1, u5);
+
+        int k = at + i;
+        _mm_storeu_si128((__m128i*) (cols->memPos + k), _mm_add_epi16(_mm_set1_epi16(location + i * RecordSize), step));
+        _mm_storel_epi64((__m128i*) (cols->interval + k), _mm_packus_epi16(interval, interval));
+        _mm_storel_epi64((__m128i*) (cols->humIn + k), _mm_packus_epi16(humIn, humIn));
+        _mm_storeu_si128((__m128i*) (cols->tempIn + k), signedWords(tempIn));
+        _mm_storel_epi64((__m128i*) (cols->humOut + k), _mm_packus_epi16(humOut, humOut));
+        _mm_storeu_si128((__m128i*) (cols->tempOut + k), signedWords(tempOut));
+        _mm_storeu_si128((__m128i*) (cols->press + k), press);
+        _mm_storel_epi64((__m128i*) (cols->windSpeed + k), _mm_packus_epi16(windSpeed, windSpeed));
+        _mm_storeu_si128((__m128i*) (cols->gustSpeed + k), gustSpeed);
+        _mm_storel_epi64((__m128i*) (cols->windDir + k), _mm_packus_epi16(windDir, windDir));
+        _mm_storeu_si128((__m128i*) (cols->rainCounter + k), rain);
+        _mm_storel_epi64((__m128i*) (cols->errorCode + k), _mm_packus_epi16(errorCode, errorCode));
+    }
+
+    // what's left over
+    decodeColumnsScalar(cols, at + i, raw, n - i, location + i * RecordSize);
+}
+
+#undef Z
+
+#endif
+
+//! Decode n raw records into columns at..at+n-1, using the vector kernel where
+//! the CPU has it (decided on first use, build with -DNO_SIMD to do without).
+//! Bit for bit the same either way.
+//
+void decodeColumns(struct weatherColumns* cols, int at, const char* raw, int n, long location) {
+    static void (*decoder)(struct weatherColumns*, int, const char*, int, long) = NULL;
+    uint64_t started = timing ? tlnow() : 0;
+
+    if (decoder == NULL) {
+        decoder = decodeColumnsScalar;
+#ifdef DecodeSSSE3
+        if (__builtin_cpu_supports("ssse3")) {
+            decoder = decodeColumnsSSSE3;
+        }
+#endif
+    }
+    decoder(cols, at, raw, n, location);
+    rstats()->decoded += n;
+    tlspan("decode", "records", started, "records", n);
+}
+
+#define swap(type, column, a, b)    { type t = column[a]; column[a] = column[b]; column[b] = t; }
+
+//! Turn columns at..at+n-1 end for end (memory order <-> index order).
+//
+static void reverseColumns(struct weatherColumns* cols, int at, int n) {
+    for(int a = at, b = at + n - 1; a < b; a++, b--) {
+        swap(uint16_t, cols->memPos, a, b);
+        swap(uint8_t,  cols->interval, a, b);
+        swap(uint8_t,  cols->humIn, a, b);
+        swap(int16_t,  cols->tempIn, a, b);
+        swap(uint8_t,  cols->humOut, a, b);
+        swap(int16_t,  cols->tempOut, a, b);
+        swap(uint16_t, cols->press, a, b);
+        swap(uint8_t,  cols->windSpeed, a, b);
+        swap(uint16_t, cols->gustSpeed, a, b);
+        swap(uint8_t,  cols->windDir, a, b);
+        swap(uint16_t, cols->rainCounter, a, b);
+        swap(uint8_t,  cols->errorCode, a, b);
+    }
+}
+
+//! Read the n records that lie in memory from location into columns at..at+n-1,
+//! in index order.
+//
+static void readRun(struct weatherColumns* cols, int at, long location, int n) {
+    const char* raw = dpointer(location, n * RecordSize);
+    if (raw == NULL) {
+        dread(cols->raw, location, n * RecordSize);
+        raw = cols->raw;
+    }
+
+    decodeColumns(cols, at, raw, n, location);
+    reverseColumns(cols, at, n);
+}
+
+//! Read count records starting at index first. Records with increasing index lie
+//! at decreasing addresses, so the run is at most two stretches of memory: down
+//! to BaseAddress and then down from the top of device memory (see dataaddress()).
+//! Returns the number of records decoded, -1 if the range is invalid.
+//
+int readColumns(struct weatherColumns* cols, int first, int count) {
+    cols->count = 0;
+
+    if (count > cols->capacity || first < 0 || count < 0
+            || first + count > getRecordsStored()) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    long top = dataaddress(first);
+
+    // records from top down to BaseAddress
+    int run = (top - BaseAddress) / RecordSize + 1;
+    if (run > count) {
+        run = count;
+    }
+    readRun(cols, 0, top - (run - 1) * RecordSize, run);
+
+    // the rest wrap round to the top of memory
+    if (count > run) {
+        int rest = count - run;
+        readRun(cols, run, DeviceMemorySize - rest * RecordSize, rest);
+    }
+
+    cols->count = count;
+    return count;
+}
@@ -0,0 +1,62 @@
+/*
+ * File:   wbatch.h
+ *
+ * Batch (column-wise) decoding of weather records.
+ */
+
+// V0.1
+
+#ifndef _WBATCH_H
+#define	_WBATCH_H
+
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+    // A run of records decoded into one array per field. Values are kept as the
+    // device stores them: temperatures, pressure, wind/gust speed and the rain
+    // counter are in tenths (wrecord.c divides them by 10), the rest are as is.
+    struct weatherColumns {
+        int             capacity;
+        int             count;
+
+        uint16_t*       memPos;
+        uint8_t*        interval;
+        uint8_t*        humIn;
+        int16_t*        tempIn;
+        uint8_t*        humOut;
+        int16_t*        tempOut;
+        uint16_t*       press;
+        uint8_t*        windSpeed;
+        uint16_t*       gustSpeed;
+        uint8_t*        windDir;
+        uint16_t*       rainCounter;
+        uint8_t*        errorCode;
+
+        char*           raw;            // scratch for records that have to be dread()
+    };
+
+
+////////////////////////////////////////////////////////////////////////////
+//
+//   B A T C H    R O U T I N E S
+
+    // allocate columns for up to capacity records
+    int allocColumns(struct weatherColumns* cols, int capacity);
+    void freeColumns(struct weatherColumns* cols);
+
+    // read and decode count records starting at index first (0 = current), in
+    // index order, following the ring back past BaseAddress if need be
+    int readColumns(struct weatherColumns* cols, int first, int count);
+
+    // decode n raw records (in memory order) into columns at..at+n-1, vectorised
+    // where the CPU allows
+    void decodeColumns(struct weatherColumns* cols, int at, const char* raw, int n, long location);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _WBATCH_H */
@@ -43,9 +43,22 @@
 #include "header.h"
 #include "wrecord.h"
 #include "dfile.h"
+#include "outbuf.h"
+#include "timeline.h"
 
 #define todouble(v)	((double) v / 10)
 
+#define WindowBatch     256     // records listed per "decode" span on the timeline
+
+// fields the device holds in tenths, straight from the raw record
+#define rawTempIn(r)    getSignedInt((char *)((r)->rawdata + 0x02))
+#define rawTempOut(r)   getSignedInt((char *)((r)->rawdata + 0x05))
+#define rawPress(r)     getUnsignedInt((char *)((r)->rawdata + 0x07))
+#define rawWindSpeed(r) ((r)->rawdata[9] & 0xFF)
+#define rawGustSpeed(r) getUnsignedInt((char *)((r)->rawdata + 0x0A))
+
+static struct recordStats statistics;
+
 const char * directions[16] = { "N", "NNE", "NE", "NEE", "E", "SEE", "SE", "SSE", "S", "SSW", "SW", "SWW", "W", "NWW", "NW", "NNW" };
 
 
@@ -92,13 +105,10 @@ int dataaddress(int index) {
 //! Read a record at the given device memory location
 //
 weatherRecordPtr rreadl(weatherRecordPtr record, long location) {
-    char buffer[RecordSize];
-
     //printf("DEBUG: rreadl(record, %04x)\n", location);
 
     // get the raw data
-    dread(buffer, location, RecordSize);
-    memcpy(&record->rawdata, buffer, RecordSize);
+    dread((char *) record->rawdata, location, RecordSize);
 
     // load up logical record
     record->memPos	= location;
@@ -113,10 +123,18 @@ weatherRecordPtr rreadl(weatherRecordPtr record, long location) {
     record->windDir	= record->rawdata[12] & 0xFF;
     record->rainCounter	= todouble(getUnsignedInt((char *)(record->rawdata + 0x0D)));
     record->errorCode	= record->rawdata[15] & 0xFF;
+    record->previous	= NULL;
 
+    statistics.decoded++;
     return record;
 }
 
+//! The counts of records decoded and rows listed.
+//
+struct recordStats* rstats() {
+    return &statistics;
+}
+
 //! Read a record at the given index, checks for invalid index (-1 or too big
 //! which is done in dataaddress()).
 //
@@ -125,6 +143,7 @@ weatherRecordPtr rread(weatherRecordPtr record, int index) {
     //printf("DEBUG: rread() index=%d, address=%04x, current = %04x\n", index, location, getLocationOfCurrent());
 
     if (location == -1) {
+        oflush();
         printf("ERROR: invalid location for record index %d in rread, aborting...\n", index);
         exit(0);
     }
@@ -132,107 +151,182 @@ weatherRecordPtr rread(weatherRecordPtr record, int index) {
     return rreadl(record, location);
 }
 
-//! Print a record using field specifier - see help for details.
+//! The -p field letters, in the order of the ops they compile to.
 //
-void rprints(weatherRecordPtr recptr, const char* recordPrintSpecification, char* separator) {
-    const char * sp = recordPrintSpecification;
+const char printFields[] = "ahHtTrRpwgdDuUieyPc";
+
+enum printOp { opAddress, opHumOut, opHumIn, opTempOut, opTempIn, opRain, opRainDiff, opPress,
+               opWindSpeed, opGustSpeed, opDirection, opWindDir, opDate, opQuotedDate,
+               opInterval, opError, opRainRate, opPressChange, opTempChange };
+
+//! A print specification compiled to one op per field, so that listing a run
+//! of records doesn't re-scan the spec string for every one of them.
+//
+static struct {
+    const char*     spec;               // what the program was compiled from
+    const char*     separator;
+    int             separatorLength;
+    int             count;
+    unsigned char*  op;
+    int             previous;           // true if a field needs the record before
+} program;
+
+//! Check a print specification only uses known field letters. Returns true if so.
+//
+int rvalidspec(const char* recordPrintSpecification) {
+    if (recordPrintSpecification == NULL) {
+        return false;
+    }
+    for (const char* sp = recordPrintSpecification; *sp != '\0'; sp++) {
+        if (strchr(printFields, *sp) == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Compile the print specification and separator used by rprints()/rprintv().
+//! Returns false (leaving the old program in place) if the spec isn't valid.
+//
+int rcompile(const char* recordPrintSpecification, const char* separator) {
+    if (!rvalidspec(recordPrintSpecification)) {
+        printf("ERROR: invalid print specification\n");
+        return false;
+    }
 
-    if (sp == NULL) {
+    int count = strlen(recordPrintSpecification);
+    unsigned char* op = malloc(count + 1);
+    if (op == NULL) {
+        printf("ERROR: unable to allocate print program, aborting...\n");
+        exit(1);
+    }
+    program.previous = false;
+    for (int i = 0; i < count; i++) {
+        op[i] = strchr(printFields, recordPrintSpecification[i]) - printFields;
+        if (op[i] == opRainDiff || op[i] >= opRainRate) {
+            program.previous = true;
+        }
+    }
+
+    free(program.op);
+    program.spec = recordPrintSpecification;
+    program.separator = separator;
+    program.separatorLength = strlen(separator);
+    program.count = count;
+    program.op = op;
+    return true;
+}
+
+//! Make sure the program matches the spec and separator asked for (the
+//! pointers are compared, so it is normally compiled just the once).
+//
+static int rprogram(const char* recordPrintSpecification, const char* separator) {
+    if (recordPrintSpecification == NULL) {
         printf("ERROR: null print specification\n");
+        return false;
+    }
+    if (program.op == NULL || program.spec != recordPrintSpecification || program.separator != separator) {
+        return rcompile(recordPrintSpecification, separator);
+    }
+    return true;
+}
+
+//! Put out the separator (between fields only, not after the last).
+//
+static inline void rseparator(int i) {
+    if (i < program.count - 1) {
+        owrite(program.separator, program.separatorLength);
+    }
+}
+
+//! Print a record using field specifier - see help for details.
+//
+void rprints(weatherRecordPtr recptr, const char* recordPrintSpecification, const char* separator) {
+    if (!rprogram(recordPrintSpecification, separator)) {
         return;
     }
 
-    while(*sp != '\0') {
-        switch(*sp++) {
-            case 'a':   printf("%04x", recptr->memPos);             break;
-            case 'h':   printf("%d",   recptr->humOut);             break;
-            case 'H':   printf("%d",   recptr->humIn);              break;
-            case 't':   printf("%.1f", recptr->tempOut);            break;
-            case 'T':   printf("%.1f", recptr->tempIn);             break;
-            case 'r':   printf("%d",   recptr->rainCounter);        break;
-            case 'R':   printf("%d", rainMeterDifference(recptr));  break;
-            case 'p':   printf("%.1f", recptr->press);              break;
-            case 'w':   printf("%.1f", recptr->windSpeed);          break;
-            case 'g':   printf("%.1f", recptr->gustSpeed);          break;
-            case 'd':   printf("'%s'", directions[recptr->windDir]);  break;
-            case 'D':   printf("%d", recptr->windDir);              break;
-            case 'i':   printf("%d",   recptr->interval);           break;
-            case 'u':   printf("%s",   getDateTime());              break;
-            case 'U':   printf("'%s'", getDateTime());              break;
-            case 'e':	printf("%02x", recptr->errorCode);          break;
-        }
-        if (*sp != '\0') {
-            printf("%s", separator);
+    for (int i = 0; i < program.count; i++) {
+        switch(program.op[i]) {
+            case opAddress:     ohex(recptr->memPos, 4);                    break;
+            case opHumOut:      oint(recptr->humOut, 0);                    break;
+            case opHumIn:       oint(recptr->humIn, 0);                     break;
+            case opTempOut:     otenths(rawTempOut(recptr), 0);             break;
+            case opTempIn:      otenths(rawTempIn(recptr), 0);              break;
+            case opRain:        oint(recptr->rainCounter, 0);               break;
+            case opRainDiff:    oint(rainMeterDifference(recptr), 0);       break;
+            case opPress:       otenths(rawPress(recptr), 0);               break;
+            case opWindSpeed:   otenths(rawWindSpeed(recptr), 0);           break;
+            case opGustSpeed:   otenths(rawGustSpeed(recptr), 0);           break;
+            case opDirection:   oputc('\'');
+                                oputs(directions[recptr->windDir]);
+                                oputc('\'');                                break;
+            case opWindDir:     oint(recptr->windDir, 0);                   break;
+            case opInterval:    oint(recptr->interval, 0);                  break;
+            case opDate:        oputs(getDateTime());                       break;
+            case opQuotedDate:  oputc('\'');
+                                oputs(getDateTime());
+                                oputc('\'');                                break;
+            case opError:       ohex(recptr->errorCode, 2);                 break;
+            case opRainRate:    otenths(rainRate(recptr), 0);               break;
+            case opPressChange: otenths(pressureChange(recptr), 0);         break;
+            case opTempChange:  otenths(temperatureChange(recptr), 0);      break;
         }
+        rseparator(i);
     }
-    printf("\n");
+    oputc('\n');
 }
 
 //! Print a given record as a formatted row. Column headings are optional.
 //
-void rprintv(weatherRecordPtr wRec, const char* recordPrintSpecification, char* separator, int headings) {
-    const char * sp = recordPrintSpecification;
+void rprintv(weatherRecordPtr wRec, const char* recordPrintSpecification, const char* separator, int headings) {
+    static const char* heading[] = { "loc.", "hO.", "hI.", "oTemp", "iTemp", "rn.", "rdif", "Pres..",
+                                     "wSpd.", "gSpd.", "dir", "dir", "UTC date        ", "UTC date        ",
+                                     "int", "err", "rn/h.", "dPres", "dTmp." };
 
-    if (sp == NULL) {
-        printf("ERROR: null print specification\n");
+    if (!rprogram(recordPrintSpecification, separator)) {
         return;
     }
 
     if (headings > 0) {
         // print headings appropriate to the spec
-        while(*sp != '\0') {
-            switch(*sp++) {
-                case 'a':   printf("loc.");                break;
-                case 'i':   printf("int");                 break;
-                case 'H':   printf("hI.");                 break;
-                case 'h':   printf("hO.");                 break;
-                case 'T':   printf("iTemp");               break;
-                case 't':   printf("oTemp");               break;
-                case 'p':   printf("Pres..");              break;
-                case 'w':   printf("wSpd.");               break;
-                case 'g':   printf("gSpd.");               break;
-                case 'd':   printf("dir");                 break;
-                case 'D':   printf("dir");                 break;
-                case 'r':   printf("rn.");                 break;
-                case 'e':   printf("err");                 break;
-                case 'U':
-                case 'u':   printf("UTC date        ");    break;
-                case 'R':   printf("rdif");                break;
-            }
-            if (*sp != '\0') {
-                printf("%s", separator);
-            }
+        for (int i = 0; i < program.count; i++) {
+            oputs(heading[program.op[i]]);
+            rseparator(i);
         }
-        printf("\n");
+        oputc('\n');
     }
 
-    sp = recordPrintSpecification;
-    while(*sp != '\0') {
+    for (int i = 0; i < program.count; i++) {
         // print fields according to spec
-        switch(*sp++) {
-            case 'a':   printf("%04x", (unsigned int)wRec->memPos); break;
-            case 'i':   printf("%3d",  wRec->interval);             break;
-            case 'H':   printf("%3d",  wRec->humIn);                break;
-            case 'h':   printf("%3d",  wRec->humOut);               break;
-            case 'T':   printf("%5.1f",wRec->tempIn);               break;
-            case 't':   printf("%5.1f",wRec->tempOut);              break;
-            case 'p':   printf("%6.1f",wRec->press);                break;
-            case 'w':   printf("%5.1f",wRec->windSpeed);            break;
-            case 'g':   printf("%5.1f",wRec->gustSpeed);            break;
-            case 'd':   printf("%3d",  wRec->windDir);              break;
-            case 'D':   printf("%d",   wRec->windDir);              break;
-            case 'r':   printf("%3d",  wRec->rainCounter);          break;
-            case 'e':   printf("%3d",  wRec->errorCode);            break;
-            case 'u':   printf("%15s", getDateTime());              break;
-            case 'U':   printf("'%15s'",getDateTime());             break;
-
-            case 'R':   printf("%4d%s", rainMeterDifference(wRec), separator);    break;       // total width = 59
-        }
-        if (*sp != '\0') {
-            printf("%s", separator);
+        switch(program.op[i]) {
+            case opAddress:     ohex(wRec->memPos, 4);                      break;
+            case opInterval:    oint(wRec->interval, 3);                    break;
+            case opHumIn:       oint(wRec->humIn, 3);                       break;
+            case opHumOut:      oint(wRec->humOut, 3);                      break;
+            case opTempIn:      otenths(rawTempIn(wRec), 5);                break;
+            case opTempOut:     otenths(rawTempOut(wRec), 5);               break;
+            case opPress:       otenths(rawPress(wRec), 6);                 break;
+            case opWindSpeed:   otenths(rawWindSpeed(wRec), 5);             break;
+            case opGustSpeed:   otenths(rawGustSpeed(wRec), 5);             break;
+            case opDirection:   oint(wRec->windDir, 3);                     break;
+            case opWindDir:     oint(wRec->windDir, 0);                     break;
+            case opRain:        oint(wRec->rainCounter, 3);                 break;
+            case opError:       oint(wRec->errorCode, 3);                   break;
+            case opRainRate:    otenths(rainRate(wRec), 5);                 break;
+            case opPressChange: otenths(pressureChange(wRec), 5);           break;
+            case opTempChange:  otenths(temperatureChange(wRec), 5);        break;
+            case opDate:        ofield(getDateTime(), 15);                  break;
+            case opQuotedDate:  oputc('\'');
+                                ofield(getDateTime(), 15);
+                                oputc('\'');                                break;
+
+            case opRainDiff:    oint(rainMeterDifference(wRec), 4);
+                                oputs(separator);                           break;       // total width = 59
         }
+        rseparator(i);
     }
-    printf("\n");
+    oputc('\n');
 }
 
 
@@ -252,21 +346,114 @@ void rhexdump(weatherRecordPtr wRec) {
     printf("\n");
 }
 
+//! Location of the record saved before the one at location, wrapping round to
+//! the top of device memory.
+//
+static long previousaddress(long location) {
+    long address = location - RecordSize;
+    if (address < BaseAddress) {
+        address = DeviceMemorySize - RecordSize;
+    }
+    return address;
+}
+
+//! Read the record at index into the window. If the window already has it (as
+//! the previous record of the one read last) it isn't read again, and when the
+//! print program uses the record before, that is read too and linked in
+//! through previous.
+//!
+//! With a timeline, every WindowBatch records listed make a "decode" span, so
+//! the listings show their reading and decoding as -A does (see decodeColumns()).
+//! A span runs from the first record of its batch being read to the last, so it
+//! takes in the output of all but the last record too; a span per record would
+//! cost more than the decoding it timed.
+//
+weatherRecordPtr rwindow(struct recordWindow* window, int index) {
+    weatherRecordPtr record;
+
+    if (timing && window->batched == 0) {
+        window->started = tlnow();
+    }
+
+    if (window->index >= 0 && index == window->index + 1
+            && window->slot[window->current].previous != NULL) {
+        window->current ^= 1;
+        record = &window->slot[window->current];
+    }
+    else {
+        window->current = 0;
+        record = rread(&window->slot[0], index);
+    }
+    window->index = index;
+
+    if (program.previous) {
+        record->previous = rreadl(&window->slot[window->current ^ 1], previousaddress(record->memPos));
+    }
+
+    if (timing && ++window->batched == WindowBatch) {
+        rwindowend(window);
+    }
+    return record;
+}
+
+void rwindowclear(struct recordWindow* window) {
+    window->index = -1;
+    window->current = 0;
+    window->batched = 0;
+}
+
+void rwindowend(struct recordWindow* window) {
+    if (window->batched > 0) {
+        tlspan("decode", "records", window->started, "records", window->batched);
+        window->batched = 0;
+    }
+}
+
+//! The record saved before this one, read into spare if the listing didn't.
+//
+static weatherRecordPtr rprevious(weatherRecordPtr this, weatherRecordPtr spare) {
+    if (this->previous != NULL) {
+        return this->previous;
+    }
+    return rreadl(spare, previousaddress(this->memPos));
+}
+
 //! Calculate the change in the rain meter from one data reading to the next.
 //! (Used when R is present in the print spec)
 //
 int rainMeterDifference(weatherRecordPtr this) {
-    struct weatherRecord previous;
+    struct weatherRecord spare;
+    weatherRecordPtr previous = rprevious(this, &spare);
+
+    return (this->rainCounter - previous->rainCounter);
+}
 
-    // get address of previous record
-    int address = this->memPos - RecordSize;
-    if (address < 0x0100) {
-        address = 0x1000 - RecordSize;
+//! The rain meter difference as a rate per hour over the record's interval, in
+//! tenths (0 for a record with no interval).
+//
+int rainRate(weatherRecordPtr this) {
+    if (this->interval == 0) {
+        return 0;
     }
+    long tenths = rainMeterDifference(this) * 600L;
+    long half = this->interval / 2;
+    return (tenths + (tenths < 0 ? -half : half)) / (long) this->interval;
+}
 
-    // get the record
-    rreadl(&previous, address);
+//! Change in pressure since the record before, in tenths.
+//
+int pressureChange(weatherRecordPtr this) {
+    struct weatherRecord spare;
+    weatherRecordPtr previous = rprevious(this, &spare);
 
-    return (this->rainCounter - previous.rainCounter);
+    return (int) rawPress(this) - (int) rawPress(previous);
 }
 
+//! Change in outside temperature since the record before, in tenths.
+//
+int temperatureChange(weatherRecordPtr this) {
+    struct weatherRecord spare;
+    weatherRecordPtr previous = rprevious(this, &spare);
+
+    return rawTempOut(this) - rawTempOut(previous);
+}
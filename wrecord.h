@@ -11,6 +11,8 @@
 #ifndef _WRECORD_H
 #define	_WRECORD_H
 
+#include <stdint.h>
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
@@ -30,28 +32,59 @@ extern "C" {
         unsigned int	errorCode;
 
         unsigned char	rawdata[16];
+
+        struct weatherRecord* previous;	// the record saved before, if read (see rwindow())
     };
 
     typedef struct weatherRecord* weatherRecordPtr;
 
+    // the record being listed and the one saved before it, so that neither
+    // has to be read twice as a listing steps from record to record, and the
+    // batch of records on the timeline's current "decode" span
+    struct recordWindow {
+        struct weatherRecord	slot[2];
+        int			current;
+        int			index;
+        int			batched;
+        uint64_t		started;
+    };
+
 
 ////////////////////////////////////////////////////////////////////////////
 //
 //   R E C O R D    R O U T I N E S
 
+	// device memory location of the record with the given index (-1 if invalid)
+	int dataaddress(int index);
+
 	// read record at given memloc
 	weatherRecordPtr rreadl(weatherRecordPtr record, long location);
 
 	// read record at given index
 	weatherRecordPtr rread(weatherRecordPtr record, int index);
 
+	// read record at given index into the window, with the record before if needed
+	weatherRecordPtr rwindow(struct recordWindow* window, int index);
+	void rwindowclear(struct recordWindow* window);
+	// end the listing's last "decode" span (see timeline.h)
+	void rwindowend(struct recordWindow* window);
+
+	// the field letters a print specification may use
+	extern const char printFields[];
+
+	// true if the spec only uses letters from printFields
+	int rvalidspec(const char* recordPrintSpecification);
+
+	// compile spec and separator for rprints()/rprintv(), false if the spec is invalid
+	int rcompile(const char* recordPrintSpecification, const char* separator);
+
 	// print record as row with ,s
 	void rprint(weatherRecordPtr wRec);
 
 	// print a record according to the given spec with the given separator between fields
-	void rprints(weatherRecordPtr recptr, const char* recordPrintSpecification, char* separator);
+	void rprints(weatherRecordPtr recptr, const char* recordPrintSpecification, const char* separator);
 	
-	void rprintv(weatherRecordPtr wRec, const char* recordPrintSpecification, char* separator, int headings);
+	void rprintv(weatherRecordPtr wRec, const char* recordPrintSpecification, const char* separator, int headings);
 
     // hexdump of the given record
     void rhexdump(weatherRecordPtr wRec);
@@ -59,6 +92,20 @@ extern "C" {
 	// get rain counter diff from previous
 	int rainMeterDifference(weatherRecordPtr this);
 
+	// rain per hour, pressure and outside temperature change from previous, in tenths
+	int rainRate(weatherRecordPtr this);
+	int pressureChange(weatherRecordPtr this);
+	int temperatureChange(weatherRecordPtr this);
+
+	// records decoded by rreadl(), and the rows listed from them (counted by
+	// whatever lists them), for --stats
+	struct recordStats {
+	    long	decoded;
+	    long	rows;
+	};
+
+	struct recordStats* rstats();
+
 
 #ifdef	__cplusplus
 }